@@ -1,87 +1,414 @@
 #ifndef _ASYNCLOGGERCTRL_HPP_
 #define _ASYNCLOGGERCTRL_HPP_
-#include "asyncLoggerCharBuf.hpp"
-#include <mutex>
+#include "asyncLoggerRing.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <algorithm>
 #include <functional>
+#include <vector>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
 namespace mylog
 {
+    const size_t ASYNC_BATCH_SIZE = 1024;     // 后台线程一次交给sinker的最大日志条数
+    const int ASYNC_FLUSH_INTERVAL_MS = 1000; // 后台线程调用sinker flush()的间隔
+
+    /// @brief 环形缓冲区写满时的处理策略
+    enum class OverflowPolicy
+    {
+        BLOCK = 0,   // 等待消费者腾出空间，最多等待 blockTimeoutMs，超时丢弃
+        DROP_NEWEST, // 直接丢弃当前这条日志
+        DROP_OLDEST, // 放入溢出队列，队列超过上限时丢弃队列中最早的日志
+        GROW         // 放入溢出队列，队列超过上限时丢弃当前这条日志
+    };
+
+    /// @brief 异步日志器的溢出配置
+    struct OverflowOptions
+    {
+        OverflowPolicy policy = OverflowPolicy::BLOCK;
+        size_t blockTimeoutMs = 100;        // BLOCK 策略的最长等待时间，0表示一直等待
+        size_t spillLimit = 16 * 1024 * 1024; // DROP_OLDEST / GROW 溢出队列的最大字节数
+    };
+
+    /// @brief 溢出统计，都是从创建开始的累计值
+    struct OverflowStats
+    {
+        uint64_t blocked = 0;   // 因缓冲区满而等待的次数
+        uint64_t blockedUs = 0; // 等待的总时间，微秒
+        uint64_t dropped = 0;   // 丢弃的日志条数
+        uint64_t spilled = 0;   // 进入溢出队列的日志条数
+        uint64_t truncated = 0; // 超过 AsyncLoggerRing::maxMessageSize() 被截断的日志条数
+    };
+
+    class AsyncLoggerBackend;
+
+    /**
+     * @brief 异步日志控制器
+     *
+     *      生产者把日志写入无锁环形缓冲区，只需要几次原子操作，不加锁；
+     *      所有异步日志器共用一个后台线程(AsyncLoggerBackend)，后台线程调用 service()
+     *      把环形缓冲区中的一批日志原地交给sinker，用writev一次写出，写完再释放槽位。
+     *      环形缓冲区写满时按 OverflowPolicy 处理。溢出队列不为空时，新日志也进入溢出队列，
+     *      消费者读完环形缓冲区后再读溢出队列，保证同一线程的日志顺序不变
+     */
     class AsyncLoggerCtrl
     {
     public:
         using ptr = std::shared_ptr<AsyncLoggerCtrl>;
-        using sink_func_t = std::function<void(AsyncLoggerCharBuf &buf)>;
+        using sink_func_t = std::function<void(const struct iovec *iov, int cnt)>;
+        using flush_func_t = std::function<void()>;
     private:
-        AsyncLoggerCharBuf _consumeBuf; // 消费者缓冲区
-        AsyncLoggerCharBuf _produceBuf; // 生产者缓冲区
+        AsyncLoggerRing _ring;          // 生产者写入的环形缓冲区
+        OverflowOptions _overflow;      // 溢出策略
+
+        std::mutex _spillMtx;           // 保护溢出队列
+        std::deque<std::string> _spill; // 溢出队列
+        size_t _spillBytes;             // 溢出队列中日志的总字节数
+        std::atomic<bool> _spilling;    // 溢出队列是否不为空
+        std::vector<std::string> _spillBatch; // 后台线程从溢出队列取出的一批日志
 
-        std::mutex _mtx;                      // 控制生产者与消费者互斥
-        std::condition_variable _consumeCond; // 控制生产者与消费者同步
-        std::condition_variable _produceCond; // 控制生产者与消费者同步
+        std::mutex _waitMtx;              // 等待环形缓冲区腾出空间的生产者
+        std::condition_variable _waitCond;
+        std::atomic<int> _waiters;        // 正在等待的生产者个数，为0时消费者不需要通知
 
-        bool _stoped;  // 退出标志，异步日志控制器要退出时设置为true
-        sink_func_t _sink;          // 实际日志落地的函数，由AsyncLogger传入
-        std::thread _consumer; // 消费者线程
+        std::atomic<uint64_t> _blocked;
+        std::atomic<uint64_t> _blockedUs;
+        std::atomic<uint64_t> _dropped;
+        std::atomic<uint64_t> _spilled;
+        std::atomic<uint64_t> _truncated;
+
+        std::atomic<bool> _stoped;      // 退出标志，异步日志控制器要退出时设置为true
+        sink_func_t _sink;              // 实际日志落地的函数，由AsyncLogger传入
+        flush_func_t _flush;            // 后台线程定期调用，由AsyncLogger传入
+        AsyncLoggerBackend &_backend;   // 共用的后台线程
 
     public:
-        AsyncLoggerCtrl(sink_func_t sink)
-            : _stoped(false), _sink(sink), _consumer(std::thread(&AsyncLoggerCtrl::threadRunning, this))
+        AsyncLoggerCtrl(sink_func_t sink, flush_func_t flush, const OverflowOptions &overflow = OverflowOptions());
+        ~AsyncLoggerCtrl();
+        /// @brief 生产者生产数据
+        /// @param reliable 为true时不受溢出策略影响，一直等到写入为止，用于不能丢失的记录
+        /// @return 日志是否被接收(写入环形缓冲区或溢出队列)
+        bool push(const char *data, size_t len, bool reliable = false)
         {
-            std::cout << "异步日志器控制器创建成功.\n";
+            if(_stoped) 
+                return false;
+            if (len > AsyncLoggerRing::maxMessageSize())
+            {
+                len = AsyncLoggerRing::maxMessageSize();
+                _truncated.fetch_add(1, std::memory_order_relaxed);
+            }
+            // 1.写入环形缓冲区，写满时按溢出策略处理
+            bool ok;
+            if (reliable)
+                ok = pushWait(data, len, 0);
+            else if (!_spilling.load(std::memory_order_acquire) && _ring.tryPush(data, len))
+                ok = true;
+            else
+                ok = overflow(data, len);
+            // 2.后台线程在睡眠时才需要唤醒
+            if (ok)
+                notify();
+            return ok;
         }
-        ~AsyncLoggerCtrl()
+        /// @brief 记录一条生产者自己丢弃的日志，例如无法截断的二进制记录
+        void discard()
         {
-            _stoped = true;
-            _consumeCond.notify_all();
-            _consumer.join();
+            _dropped.fetch_add(1, std::memory_order_relaxed);
         }
-        // 生产者生产数据
-        void push(const std::string &logMsg)
+        OverflowStats stats() const
         {
-            if(_stoped) 
+            OverflowStats st;
+            st.blocked = _blocked.load(std::memory_order_relaxed);
+            st.blockedUs = _blockedUs.load(std::memory_order_relaxed);
+            st.dropped = _dropped.load(std::memory_order_relaxed);
+            st.spilled = _spilled.load(std::memory_order_relaxed);
+            st.truncated = _truncated.load(std::memory_order_relaxed);
+            return st;
+        }
+
+        /// @brief 由后台线程调用：把一批日志交给sinker
+        /// @return 是否处理了日志
+        bool service()
+        {
+            // 1.环形缓冲区中的日志原地写出，写完再释放槽位
+            struct iovec iov[ASYNC_BATCH_SIZE];
+            uint64_t end;
+            size_t cnt = _ring.peek(iov, ASYNC_BATCH_SIZE, end);
+            if (cnt > 0)
+            {
+                _sink(iov, (int)cnt);
+                _ring.release(end);
+                signalWaiters();
+                return true;
+            }
+            // 2.环形缓冲区读空后再读溢出队列
+            if (!_spilling.load(std::memory_order_acquire))
+                return false;
+            {
+                std::unique_lock<std::mutex> lock(_spillMtx);
+                while (!_spill.empty() && _spillBatch.size() < ASYNC_BATCH_SIZE)
+                {
+                    _spillBytes -= _spill.front().size();
+                    _spillBatch.push_back(std::move(_spill.front()));
+                    _spill.pop_front();
+                }
+                if (_spill.empty())
+                    _spilling.store(false, std::memory_order_release);
+            }
+            for (size_t i = 0; i < _spillBatch.size(); ++i)
+            {
+                iov[i].iov_base = &_spillBatch[i][0];
+                iov[i].iov_len = _spillBatch[i].size();
+            }
+            _sink(iov, (int)_spillBatch.size());
+            _spillBatch.clear();
+            return true;
+        }
+        /// @brief 是否还有没写出的日志，由后台线程在睡眠前调用
+        bool pending() const
+        {
+            return _ring.readable() || _spilling.load(std::memory_order_seq_cst);
+        }
+        /// @brief 由后台线程定期调用
+        void flush()
+        {
+            _flush();
+        }
+
+    private:
+        void notify();
+        void wakeup();
+        // 环形缓冲区已满或溢出队列不为空时的处理
+        bool overflow(const char *data, size_t len)
+        {
+            switch (_overflow.policy)
+            {
+            case OverflowPolicy::BLOCK:
+                if (pushWait(data, len, _overflow.blockTimeoutMs))
+                    return true;
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case OverflowPolicy::DROP_NEWEST:
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            default:
+                return spill(data, len);
+            }
+        }
+        // 等待环形缓冲区腾出空间，timeoutMs为0时一直等待
+        // 唤醒一次消费者后睡在条件变量上，消费者释放槽位后通知，不忙等
+        bool pushWait(const char *data, size_t len, size_t timeoutMs)
+        {
+            if (_ring.tryPush(data, len))
+                return true;
+            _blocked.fetch_add(1, std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = start + std::chrono::milliseconds(timeoutMs);
+            bool ok = false;
+            // 先登记再检查缓冲区：消费者释放槽位后再读 _waiters，两边至少有一方能看到对方
+            _waiters.fetch_add(1, std::memory_order_seq_cst);
+            wakeup();
+            {
+                std::unique_lock<std::mutex> lock(_waitMtx);
+                while (!_stoped)
+                {
+                    if (_ring.tryPush(data, len))
+                    {
+                        ok = true;
+                        break;
+                    }
+                    if (timeoutMs == 0)
+                        _waitCond.wait(lock);
+                    else if (_waitCond.wait_until(lock, deadline) == std::cv_status::timeout)
+                    {
+                        ok = _ring.tryPush(data, len);
+                        break;
+                    }
+                }
+            }
+            _waiters.fetch_sub(1, std::memory_order_relaxed);
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            _blockedUs.fetch_add((uint64_t)us, std::memory_order_relaxed);
+            return ok;
+        }
+        // 消费者释放槽位后通知等待的生产者。加锁保证不会在生产者检查之后、睡眠之前通知
+        void signalWaiters()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_waiters.load(std::memory_order_relaxed) == 0)
                 return;
-            // 1.生产时，加锁，且条件为：生产缓冲区有空间可写
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _produceCond.wait(lock, [&]{
-                    return _produceBuf.writableSize() >= logMsg.size();
-                });
-                _produceBuf.push(logMsg.c_str(), logMsg.size());
+                std::unique_lock<std::mutex> lock(_waitMtx);
             }
-            // 2.唤醒消费者线程
-            _consumeCond.notify_all();
+            _waitCond.notify_all();
+        }
+        // 放入溢出队列。队列为空且环形缓冲区有空间时直接写入环形缓冲区
+        bool spill(const char *data, size_t len)
+        {
+            std::unique_lock<std::mutex> lock(_spillMtx);
+            if (_spill.empty() && _ring.tryPush(data, len))
+                return true;
+            if (_spillBytes + len > _overflow.spillLimit)
+            {
+                if (_overflow.policy == OverflowPolicy::GROW || len > _overflow.spillLimit)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                while (_spillBytes + len > _overflow.spillLimit)
+                {
+                    _spillBytes -= _spill.front().size();
+                    _spill.pop_front();
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            _spill.emplace_back(data, len);
+            _spillBytes += len;
+            _spilled.fetch_add(1, std::memory_order_relaxed);
+            _spilling.store(true, std::memory_order_seq_cst);
+            return true;
+        }
+    };
+
+    /**
+     * @brief 所有异步日志器共用的后台线程
+     *
+     *      依次调用每个控制器的 service()，都没有日志时阻塞在eventfd上，
+     *      生产者只在后台线程睡眠时才写eventfd唤醒它。每隔 ASYNC_FLUSH_INTERVAL_MS 调用一次各日志器的flush()，
+     *      让按时间同步的sinker在空闲时也能把数据落盘。
+     *      后台线程随进程一直存在，对象不析构，日志器在静态对象析构时仍然可以安全地注销
+     */
+    class AsyncLoggerBackend
+    {
+    private:
+        std::mutex _mtx;                       // 保护 _ctrls，后台线程处理日志时持有
+        std::vector<AsyncLoggerCtrl *> _ctrls; // 注册的控制器
+        int _efd;                              // 唤醒后台线程的eventfd
+        std::atomic<bool> _sleeping;           // 后台线程是否准备睡眠
+        std::thread _thread;
+
+        AsyncLoggerBackend()
+            : _efd(eventfd(0, EFD_CLOEXEC)), _sleeping(false)
+        {
+            assert(_efd >= 0);
+            _thread = std::thread(&AsyncLoggerBackend::threadRunning, this);
+            _thread.detach();
+        }
+        AsyncLoggerBackend(const AsyncLoggerBackend &) = delete;
+        AsyncLoggerBackend &operator=(const AsyncLoggerBackend &) = delete;
+
+    public:
+        static AsyncLoggerBackend &instance()
+        {
+            static AsyncLoggerBackend *backend = new AsyncLoggerBackend();
+            return *backend;
+        }
+        void add(AsyncLoggerCtrl *ctrl)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _ctrls.push_back(ctrl);
+        }
+        // 注销控制器，并在当前线程写出它剩余的日志。返回后后台线程不会再访问它
+        void remove(AsyncLoggerCtrl *ctrl)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _ctrls.erase(std::remove(_ctrls.begin(), _ctrls.end(), ctrl), _ctrls.end());
+            while (ctrl->service())
+                ;
+            ctrl->flush();
+        }
+        // 后台线程在睡眠时才需要唤醒。
+        // 后台线程先置 _sleeping 再检查有没有日志，生产者先写入日志再读 _sleeping(都是seq_cst)，
+        // 两边至少有一方能看到对方，不会漏掉唤醒；生产者用exchange抢到唤醒权，
+        // 同一次睡眠只有一个生产者写eventfd，大量生产者同时写日志时不会每条都产生一次系统调用
+        void notify()
+        {
+            if (_sleeping.load(std::memory_order_seq_cst) && _sleeping.exchange(false))
+                wakeup();
+        }
+        void wakeup()
+        {
+            uint64_t one = 1;
+            ssize_t ret = write(_efd, &one, sizeof(one));
+            (void)ret;
         }
 
     private:
-        // 消费者线程工作函数
         void threadRunning()
         {
             std::cout << "异步日志工作线程创建成功.\n";
-            while(true)
+            auto lastFlush = std::chrono::steady_clock::now();
+            while (true)
             {
-                sleep(1);
-                if(_stoped && _produceBuf.empty())
-                    return;
-                // 1.消费时，加锁，且条件为：生产缓冲区有数据
+                bool busy = false;
+                bool pending = false;
                 {
                     std::unique_lock<std::mutex> lock(_mtx);
-                    _consumeCond.wait(lock, [&]{
-                        return !_produceBuf.empty() || _stoped;
-                    });
-                    // 交换缓冲区
-                    _produceBuf.swap(_consumeBuf);
+                    // 1.每个控制器处理一批，多个日志器轮流写出
+                    for (AsyncLoggerCtrl *ctrl : _ctrls)
+                        busy = ctrl->service() || busy;
+                    // 2.定期flush
+                    auto now = std::chrono::steady_clock::now();
+                    if (now - lastFlush >= std::chrono::milliseconds(ASYNC_FLUSH_INTERVAL_MS))
+                    {
+                        for (AsyncLoggerCtrl *ctrl : _ctrls)
+                            ctrl->flush();
+                        lastFlush = now;
+                    }
+                    if (busy)
+                        continue;
+                    // 3.没有数据时睡眠。先声明要睡眠再检查一次，避免错过生产者在此期间提交的日志
+                    _sleeping.store(true, std::memory_order_seq_cst);
+                    for (AsyncLoggerCtrl *ctrl : _ctrls)
+                        pending = pending || ctrl->pending();
+                }
+                if (!pending)
+                {
+                    struct pollfd pfd = {_efd, POLLIN, 0};
+                    if (poll(&pfd, 1, ASYNC_FLUSH_INTERVAL_MS) > 0)
+                    {
+                        uint64_t cnt;
+                        ssize_t ret = read(_efd, &cnt, sizeof(cnt));
+                        (void)ret;
+                    }
                 }
-                // 2.唤醒生产者线程
-                _produceCond.notify_all();
-                // 3.消费数据
-                _sink(_consumeBuf);
-                // 4.消费缓冲区清空
-                _consumeBuf.clear();
+                _sleeping.store(false, std::memory_order_relaxed);
             }
         }
     };
+
+    inline AsyncLoggerCtrl::AsyncLoggerCtrl(sink_func_t sink, flush_func_t flush, const OverflowOptions &overflow)
+        : _overflow(overflow), _spillBytes(0), _spilling(false),
+          _waiters(0), _blocked(0), _blockedUs(0), _dropped(0), _spilled(0), _truncated(0),
+          _stoped(false), _sink(sink), _flush(flush), _backend(AsyncLoggerBackend::instance())
+    {
+        _spillBatch.reserve(ASYNC_BATCH_SIZE);
+        _backend.add(this);
+        std::cout << "异步日志器控制器创建成功.\n";
+    }
+    inline AsyncLoggerCtrl::~AsyncLoggerCtrl()
+    {
+        _stoped = true;
+        signalWaiters();
+        _backend.remove(this);
+    }
+    inline void AsyncLoggerCtrl::notify()
+    {
+        _backend.notify();
+    }
+    inline void AsyncLoggerCtrl::wakeup()
+    {
+        _backend.wakeup();
+    }
 }
 
-#endif
\ No newline at end of file
+#endif
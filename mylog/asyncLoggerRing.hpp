@@ -0,0 +1,159 @@
+#ifndef _ASYNCLOGGERRING_HPP_
+#define _ASYNCLOGGERRING_HPP_
+
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <sys/uio.h>
+
+namespace mylog
+{
+    const size_t RING_SLOT_SIZE = 128;   // 每个槽的大小
+    const size_t RING_SLOT_COUNT = 8192; // 槽的个数，必须是2的幂。总容量与原来的缓冲区相同，1Mb
+
+    /**
+     * @brief 多生产者单消费者的无锁环形缓冲区
+     *
+     *      缓冲区由 RING_SLOT_COUNT 个定长槽组成，一条日志占用连续的 n 个槽：
+     *      1.生产者用一次CAS移动 _head，预留 n 个连续的槽；剩余的槽不够连续放下时，
+     *        连同末尾的槽一起预留，末尾的槽作为填充，日志从第0个槽开始写
+     *      2.生产者拷贝日志内容后，把槽数写入第一个槽的 _spans，表示提交
+     *      3.消费者从 _tail 开始按顺序读取已提交的日志，读完后清空 _spans 并移动 _tail
+     *      日志内容存放在连续的 _data 中，跨槽的日志不需要拼接，
+     *      消费者可以用 peek/release 把一批日志原地交给writev，写完再释放槽位
+     */
+    class AsyncLoggerRing
+    {
+    private:
+        static const uint32_t PAD = UINT32_MAX; // 填充槽的长度标记
+
+        std::vector<char> _data;                 // 日志内容，第i个槽对应 [i*RING_SLOT_SIZE, (i+1)*RING_SLOT_SIZE)
+        std::vector<uint32_t> _lens;             // 每条日志的长度，写在第一个槽上
+        std::unique_ptr<std::atomic<uint32_t>[]> _spans; // 每条日志占用的槽数，0表示未提交
+        alignas(64) std::atomic<uint64_t> _head; // 生产者预留的位置，单调递增
+        alignas(64) std::atomic<uint64_t> _tail; // 消费者读取的位置，单调递增
+
+    public:
+        AsyncLoggerRing()
+            : _data(RING_SLOT_COUNT * RING_SLOT_SIZE), _lens(RING_SLOT_COUNT),
+              _spans(new std::atomic<uint32_t>[RING_SLOT_COUNT]), _head(0), _tail(0)
+        {
+            for (size_t i = 0; i < RING_SLOT_COUNT; ++i)
+                _spans[i].store(0, std::memory_order_relaxed);
+        }
+        // 单条日志的最大长度，超过的部分被截断
+        static size_t maxMessageSize()
+        {
+            return RING_SLOT_COUNT / 4 * RING_SLOT_SIZE;
+        }
+        /// @brief 写入一条日志
+        /// @return 缓冲区空间不足时返回false，不写入
+        bool tryPush(const char *data, size_t len)
+        {
+            if (len > maxMessageSize())
+                len = maxMessageSize();
+            uint32_t n = (uint32_t)((len + RING_SLOT_SIZE - 1) / RING_SLOT_SIZE);
+            if (n == 0)
+                n = 1;
+            // 1.CAS预留连续的槽
+            uint64_t head = _head.load(std::memory_order_relaxed);
+            uint64_t need;
+            size_t idx;
+            do
+            {
+                idx = head & (RING_SLOT_COUNT - 1);
+                need = (idx + n > RING_SLOT_COUNT) ? (RING_SLOT_COUNT - idx) + n : n;
+                if (head + need - _tail.load(std::memory_order_acquire) > RING_SLOT_COUNT)
+                    return false;
+            } while (!_head.compare_exchange_weak(head, head + need, std::memory_order_relaxed));
+            // 2.末尾放不下时，末尾的槽作为填充
+            if (need != n)
+            {
+                _lens[idx] = PAD;
+                _spans[idx].store((uint32_t)(need - n), std::memory_order_release);
+                idx = 0;
+            }
+            // 3.拷贝内容并提交
+            memcpy(&_data[idx * RING_SLOT_SIZE], data, len);
+            _lens[idx] = (uint32_t)len;
+            _spans[idx].store(n, std::memory_order_seq_cst);
+            return true;
+        }
+        /// @brief 消费者读取从 _tail 开始连续提交的日志，每条调用一次 fn(data, len)。
+        ///        fn返回false时停止，该条日志不被消费
+        /// @return 消费的日志条数
+        template <typename Func>
+        size_t consume(Func fn)
+        {
+            size_t count = 0;
+            uint64_t tail = _tail.load(std::memory_order_relaxed);
+            while (true)
+            {
+                size_t idx = tail & (RING_SLOT_COUNT - 1);
+                uint32_t n = _spans[idx].load(std::memory_order_acquire);
+                if (n == 0)
+                    break; // 没有数据，或生产者还没有提交
+                if (_lens[idx] != PAD)
+                {
+                    if (!fn(&_data[idx * RING_SLOT_SIZE], (size_t)_lens[idx]))
+                        break;
+                    ++count;
+                }
+                _spans[idx].store(0, std::memory_order_relaxed);
+                tail += n;
+                _tail.store(tail, std::memory_order_release);
+            }
+            return count;
+        }
+        /// @brief 消费者批量读取：把从 _tail 开始连续提交的日志(最多max条)填入iov，不移动 _tail。
+        ///        iov指向缓冲区内部，release(end)之前一直有效，可以直接交给writev
+        /// @param end 返回这批日志之后的位置，传给release
+        /// @return 日志条数
+        size_t peek(struct iovec *iov, size_t max, uint64_t &end)
+        {
+            size_t count = 0;
+            end = _tail.load(std::memory_order_relaxed);
+            while (count < max)
+            {
+                size_t idx = end & (RING_SLOT_COUNT - 1);
+                uint32_t n = _spans[idx].load(std::memory_order_acquire);
+                if (n == 0)
+                    break;
+                if (_lens[idx] != PAD)
+                {
+                    iov[count].iov_base = &_data[idx * RING_SLOT_SIZE];
+                    iov[count].iov_len = _lens[idx];
+                    ++count;
+                }
+                end += n;
+            }
+            return count;
+        }
+        /// @brief 释放peek读取的日志占用的槽，之后生产者才能重新使用
+        void release(uint64_t end)
+        {
+            uint64_t tail = _tail.load(std::memory_order_relaxed);
+            while (tail < end)
+            {
+                size_t idx = tail & (RING_SLOT_COUNT - 1);
+                tail += _spans[idx].load(std::memory_order_relaxed);
+                _spans[idx].store(0, std::memory_order_relaxed);
+            }
+            _tail.store(end, std::memory_order_release);
+        }
+        // 队首是否有已提交的日志，只能由消费者调用
+        bool readable() const
+        {
+            return _spans[_tail.load(std::memory_order_relaxed) & (RING_SLOT_COUNT - 1)].load(std::memory_order_seq_cst) != 0;
+        }
+        // 缓冲区中是否没有预留的槽
+        bool empty() const
+        {
+            return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,311 @@
+/**
+ * 二进制日志解码工具，把 BinaryLogger 写出的日志还原成与默认格式相同的文本：
+ *   [时间][等级][日志器名称][线程id][文件 : 行号]\t日志内容
+ * 用法：./binDecode file [file ...]
+ * 每个文件都可以单独解码：切分文件时新文件开头会重新写入调用点定义，切分只发生在记录之间。
+ * 传入多个文件时按顺序解码，当作一个连续的数据流。RollFileSinker 压缩过的 .gz 文件可以直接传入。
+ * 编译：g++ -std=c++11 -O2 binDecode.cc -o binDecode -lz
+ */
+#include "binLog.hpp"
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+    /*调用点定义*/
+    struct Def
+    {
+        int level;
+        uint32_t line;
+        std::string file;
+        std::string logger;
+        std::string format;
+    };
+
+    /*一个参数*/
+    struct Arg
+    {
+        char type;
+        int64_t i;
+        uint64_t u;
+        double d;
+        std::string s;
+    };
+
+    /*按顺序读取记录体中的字段*/
+    class Reader
+    {
+    private:
+        const char *_p;
+        const char *_end;
+
+    public:
+        Reader(const char *p, size_t len) : _p(p), _end(p + len) {}
+        template <typename T>
+        bool get(T &val)
+        {
+            if ((size_t)(_end - _p) < sizeof(T))
+                return false;
+            memcpy(&val, _p, sizeof(T));
+            _p += sizeof(T);
+            return true;
+        }
+        bool getBytes(std::string &str, size_t len)
+        {
+            if ((size_t)(_end - _p) < len)
+                return false;
+            str.assign(_p, len);
+            _p += len;
+            return true;
+        }
+        template <typename Len>
+        bool getString(std::string &str)
+        {
+            Len len;
+            return get(len) && getBytes(str, len);
+        }
+    };
+
+    /*按顺序读取多个文件，当作一个连续的数据流。gzopen对没有压缩的文件直接读取*/
+    class Input
+    {
+    private:
+        std::vector<std::string> _paths;
+        size_t _next;
+        gzFile _fp;
+
+    public:
+        Input(const std::vector<std::string> &paths) : _paths(paths), _next(0), _fp(nullptr) {}
+        ~Input()
+        {
+            if (_fp != nullptr)
+                gzclose(_fp);
+        }
+        /*读满len个字节，所有文件都读完时返回读到的字节数*/
+        size_t read(char *buf, size_t len)
+        {
+            size_t done = 0;
+            while (done < len)
+            {
+                if (_fp == nullptr)
+                {
+                    if (_next == _paths.size())
+                        break;
+                    const std::string &path = _paths[_next++];
+                    _fp = gzopen(path.c_str(), "rb");
+                    if (_fp == nullptr)
+                    {
+                        fprintf(stderr, "打开文件失败: %s\n", path.c_str());
+                        continue;
+                    }
+                }
+                int n = gzread(_fp, buf + done, (unsigned)(len - done));
+                if (n > 0)
+                    done += n;
+                if (done < len)
+                {
+                    if (n < 0)
+                        fprintf(stderr, "读取文件失败: %s\n", _paths[_next - 1].c_str());
+                    gzclose(_fp);
+                    _fp = nullptr;
+                }
+            }
+            return done;
+        }
+    };
+
+    const char *levelName(int lv)
+    {
+        return mylog::Level::toCString((mylog::Level::Value)lv);
+    }
+
+    /*按格式串还原日志内容，参数的类型以记录中的类型为准，长度修饰符被忽略*/
+    std::string render(const std::string &fmt, const std::vector<Arg> &args)
+    {
+        std::string out;
+        size_t next = 0;
+        char tmp[512];
+        for (size_t i = 0; i < fmt.size(); ++i)
+        {
+            if (fmt[i] != '%')
+            {
+                out += fmt[i];
+                continue;
+            }
+            if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+            {
+                out += '%';
+                ++i;
+                continue;
+            }
+            // 解析 %[flags][width][.precision][length]conversion
+            std::string spec = "%";
+            size_t j = i + 1;
+            while (j < fmt.size() && strchr("-+ #0", fmt[j]))
+                spec += fmt[j++];
+            while (j < fmt.size() && (isdigit((unsigned char)fmt[j]) || fmt[j] == '.' || fmt[j] == '*'))
+            {
+                if (fmt[j] == '*')
+                {
+                    spec += next < args.size() ? std::to_string(args[next].type == 'i' ? args[next].i : (int64_t)args[next].u) : "0";
+                    ++next;
+                    ++j;
+                }
+                else
+                    spec += fmt[j++];
+            }
+            while (j < fmt.size() && strchr("hlLqjzt", fmt[j]))
+                ++j;
+            if (j >= fmt.size())
+                break;
+            char conv = fmt[j];
+            i = j;
+            if (next >= args.size())
+            {
+                out += "<missing>";
+                continue;
+            }
+            const Arg &a = args[next++];
+            int n = 0;
+            switch (a.type)
+            {
+            case 'i':
+                if (conv == 'c')
+                    n = snprintf(tmp, sizeof(tmp), (spec + "c").c_str(), (int)a.i);
+                else if (strchr("diouxX", conv))
+                    n = snprintf(tmp, sizeof(tmp), (spec + "ll" + conv).c_str(), (long long)a.i);
+                else
+                    n = snprintf(tmp, sizeof(tmp), "%lld", (long long)a.i);
+                break;
+            case 'u':
+                if (conv == 'c')
+                    n = snprintf(tmp, sizeof(tmp), (spec + "c").c_str(), (int)a.u);
+                else if (strchr("diouxX", conv))
+                    n = snprintf(tmp, sizeof(tmp), (spec + "ll" + conv).c_str(), (unsigned long long)a.u);
+                else
+                    n = snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)a.u);
+                break;
+            case 'p':
+                n = snprintf(tmp, sizeof(tmp), "%p", (void *)(uintptr_t)a.u);
+                break;
+            case 'd':
+                if (strchr("fFeEgGaA", conv))
+                    n = snprintf(tmp, sizeof(tmp), (spec + conv).c_str(), a.d);
+                else
+                    n = snprintf(tmp, sizeof(tmp), "%g", a.d);
+                break;
+            case 's':
+                if (conv == 's' && spec.size() > 1)
+                    n = snprintf(tmp, sizeof(tmp), (spec + "s").c_str(), a.s.c_str());
+                else
+                {
+                    out += a.s;
+                    continue;
+                }
+                break;
+            }
+            if (n > 0)
+                out.append(tmp, std::min((size_t)n, sizeof(tmp) - 1));
+        }
+        return out;
+    }
+
+    void printHeader(int64_t us, int level, const std::string &logger, uint64_t tid, const std::string &file, uint32_t line)
+    {
+        time_t sec = (time_t)(us / 1000000);
+        tm t;
+        localtime_r(&sec, &t);
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &t);
+        printf("[%s.%03d][%s][%s][%lu][%s : %u]\t", date, (int)(us % 1000000 / 1000), levelName(level),
+               logger.c_str(), (unsigned long)tid, file.c_str(), line);
+    }
+
+    /*解码所有文件*/
+    void decode(Input &in)
+    {
+        std::unordered_map<uint32_t, Def> defs;
+        std::string body;
+        while (true)
+        {
+            char type;
+            uint32_t len;
+            if (in.read(&type, 1) != 1 || in.read((char *)&len, sizeof(len)) != sizeof(len))
+                break;
+            body.resize(len);
+            if (len > 0 && in.read(&body[0], len) != len)
+            {
+                fprintf(stderr, "最后一条记录不完整\n");
+                break;
+            }
+            Reader r(body.data(), body.size());
+            if (type == 'D')
+            {
+                uint32_t id;
+                uint8_t level;
+                Def def;
+                if (r.get(id) && r.get(level) && r.get(def.line) && r.getString<uint16_t>(def.file) &&
+                    r.getString<uint16_t>(def.logger) && r.getString<uint16_t>(def.format))
+                {
+                    def.level = level;
+                    defs[id] = def;
+                }
+            }
+            else if (type == 'R')
+            {
+                uint32_t id;
+                int64_t us;
+                uint64_t tid;
+                uint8_t argc;
+                if (!r.get(id) || !r.get(us) || !r.get(tid) || !r.get(argc))
+                    continue;
+                std::vector<Arg> args(argc);
+                bool ok = true;
+                for (Arg &a : args)
+                {
+                    ok = r.get(a.type);
+                    if (ok && a.type == 'i')
+                        ok = r.get(a.i);
+                    else if (ok && (a.type == 'u' || a.type == 'p'))
+                        ok = r.get(a.u);
+                    else if (ok && a.type == 'd')
+                        ok = r.get(a.d);
+                    else if (ok && a.type == 's')
+                        ok = r.getString<uint32_t>(a.s);
+                    else
+                        ok = false;
+                    if (!ok)
+                        break;
+                }
+                auto it = defs.find(id);
+                if (it == defs.end())
+                {
+                    printf("<未知的调用点 %u>\n", id);
+                    continue;
+                }
+                const Def &def = it->second;
+                printHeader(us, def.level, def.logger, tid, def.file, def.line);
+                printf("%s%s\n", render(def.format, args).c_str(), ok ? "" : " <参数不完整>");
+            }
+            else if (type == 'T')
+                fwrite(body.data(), 1, body.size(), stdout);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "用法: %s file [file ...]\n", argv[0]);
+        return 1;
+    }
+    Input in(std::vector<std::string>(argv + 1, argv + argc));
+    decode(in);
+    return 0;
+}
@@ -0,0 +1,193 @@
+#ifndef _BINLOG_HPP_
+#define _BINLOG_HPP_
+
+#include "level.hpp"
+#include "logBuffer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mylog
+{
+    /**
+     * 二进制日志的记录格式。
+     * 每条记录以 [1字节类型][4字节长度] 开头，后面是长度为该值的记录体，整数都是本机字节序：
+     *  'D' 调用点定义：[u32 id][u8 等级][u32 行号][u16 文件名长度][文件名][u16 日志器名称长度][日志器名称][u16 格式串长度][格式串]
+     *  'R' 一条日志：  [u32 id][i64 微秒时间戳][u64 线程id][u8 参数个数][参数...]
+     *  'T' 一行文本：  [已格式化的文本]，二进制日志器上调用普通的 info() 等接口时产生
+     * 参数为 [1字节类型][值]：'i' i64，'u' u64，'d' double，'p' u64指针值，'s' [u32长度][字节]
+     * 同一日志器上，一个调用点的 'D' 记录总是在它的第一条 'R' 记录之前写入；
+     * 文件切分后，新文件开头会重新写入已经定义的调用点，每个文件都可以单独解码。
+     * 同一个id的 'D' 可能出现多次，内容相同
+     */
+    namespace binlog
+    {
+        const size_t MAX_SITES = 16384; // 调用点个数上限
+
+        /*调用点信息，注册后不再修改*/
+        struct Site
+        {
+            Level::Value level;
+            const char *file;
+            size_t line;
+            const char *format;
+        };
+
+        /*全局的调用点表，每个调用点第一次执行时注册一次，得到一个id*/
+        class Registry
+        {
+        private:
+            std::mutex _mtx;
+            std::vector<Site> _sites;
+
+        public:
+            static Registry &instance()
+            {
+                static Registry reg;
+                return reg;
+            }
+            uint32_t add(Level::Value level, const char *file, size_t line, const char *format)
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_sites.size() >= MAX_SITES)
+                    return UINT32_MAX;
+                _sites.push_back(Site{level, file, line, format});
+                return (uint32_t)(_sites.size() - 1);
+            }
+            Site get(uint32_t id)
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                return _sites[id];
+            }
+        };
+
+        template <typename T>
+        inline void put(LogBuffer &buf, T val)
+        {
+            buf.append((const char *)&val, sizeof(val));
+        }
+        inline void putString(LogBuffer &buf, const char *str, size_t len)
+        {
+            buf.append('s');
+            put<uint32_t>(buf, (uint32_t)len);
+            buf.append(str, len);
+        }
+
+        // 按参数类型写入，整数统一扩展为64位
+        template <typename T>
+        inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+        encodeArg(LogBuffer &buf, T val)
+        {
+            buf.append('i');
+            put<int64_t>(buf, val);
+        }
+        template <typename T>
+        inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+        encodeArg(LogBuffer &buf, T val)
+        {
+            buf.append('u');
+            put<uint64_t>(buf, val);
+        }
+        template <typename T>
+        inline typename std::enable_if<std::is_enum<T>::value>::type
+        encodeArg(LogBuffer &buf, T val)
+        {
+            buf.append('i');
+            put<int64_t>(buf, (int64_t)val);
+        }
+        inline void encodeArg(LogBuffer &buf, double val)
+        {
+            buf.append('d');
+            put<double>(buf, val);
+        }
+        inline void encodeArg(LogBuffer &buf, const char *str)
+        {
+            if (str == nullptr)
+                str = "(null)";
+            putString(buf, str, strlen(str));
+        }
+        inline void encodeArg(LogBuffer &buf, char *str)
+        {
+            encodeArg(buf, (const char *)str);
+        }
+        inline void encodeArg(LogBuffer &buf, const std::string &str)
+        {
+            putString(buf, str.data(), str.size());
+        }
+        inline void encodeArg(LogBuffer &buf, const void *ptr)
+        {
+            buf.append('p');
+            put<uint64_t>(buf, (uint64_t)(uintptr_t)ptr);
+        }
+
+        inline void encodeArgs(LogBuffer &)
+        {
+        }
+        template <typename T, typename... Args>
+        inline void encodeArgs(LogBuffer &buf, const T &val, const Args &...args)
+        {
+            encodeArg(buf, val);
+            encodeArgs(buf, args...);
+        }
+
+        /*开始一条记录，长度在endRecord时回填*/
+        inline void beginRecord(LogBuffer &buf, char type)
+        {
+            buf.clear();
+            buf.append(type);
+            put<uint32_t>(buf, 0);
+        }
+        inline void endRecord(LogBuffer &buf)
+        {
+            uint32_t len = (uint32_t)(buf.size() - 5);
+            buf.overwrite(1, (const char *)&len, sizeof(len));
+        }
+        /*编码一条完整的 'R' 记录*/
+        template <typename... Args>
+        inline void encodeRecord(LogBuffer &buf, uint32_t id, int64_t us, uint64_t tid, const Args &...args)
+        {
+            beginRecord(buf, 'R');
+            put<uint32_t>(buf, id);
+            put<int64_t>(buf, us);
+            put<uint64_t>(buf, tid);
+            buf.append((char)sizeof...(Args));
+            encodeArgs(buf, args...);
+            endRecord(buf);
+        }
+
+        /*只用于编译期检查参数与格式串是否匹配，不会被调用*/
+        inline void checkFormat(const char *format, ...) __attribute__((format(printf, 1, 2)));
+        inline void checkFormat(const char *, ...)
+        {
+        }
+    }
+}
+
+/*
+    二进制日志宏：BIN_INFO_LOG(logger, "uid: %lu", uid)，logger 为 mylog::BinaryLogger*
+    调用点第一次执行时注册格式串，之后只写入 id、时间戳和参数的原始字节，不做格式化，
+    由 binDecode 工具离线还原成文本。格式串与参数在编译期按printf规则检查
+*/
+#define MYLOG_BIN_LOG(logger, lv, fmt, ...)                                                                          \
+    do                                                                                                               \
+    {                                                                                                                \
+        if ((int)lv >= MYLOG_COMPILE_LEVEL && (logger)->enabled(lv))                                                 \
+        {                                                                                                            \
+            static const uint32_t _mylog_bin_id = ::mylog::binlog::Registry::instance().add(lv, __FILE__, __LINE__, fmt); \
+            if (false)                                                                                               \
+                ::mylog::binlog::checkFormat(fmt, ##__VA_ARGS__);                                                    \
+            (logger)->logBinary(_mylog_bin_id, ##__VA_ARGS__);                                                       \
+        }                                                                                                            \
+    } while (0)
+
+#define BIN_DEBUG_LOG(logger, fmt, ...) MYLOG_BIN_LOG(logger, ::mylog::Level::Value::DEBUG, fmt, ##__VA_ARGS__)
+#define BIN_INFO_LOG(logger, fmt, ...) MYLOG_BIN_LOG(logger, ::mylog::Level::Value::INFO, fmt, ##__VA_ARGS__)
+#define BIN_WARN_LOG(logger, fmt, ...) MYLOG_BIN_LOG(logger, ::mylog::Level::Value::WARN, fmt, ##__VA_ARGS__)
+#define BIN_ERROR_LOG(logger, fmt, ...) MYLOG_BIN_LOG(logger, ::mylog::Level::Value::ERROR, fmt, ##__VA_ARGS__)
+#define BIN_FATAL_LOG(logger, fmt, ...) MYLOG_BIN_LOG(logger, ::mylog::Level::Value::FATAL, fmt, ##__VA_ARGS__)
+
+#endif
@@ -2,163 +2,14 @@
 #define _FORMAT_HPP_
 
 #include "logInfo.hpp"
+#include "logBuffer.hpp"
 #include "level.hpp"
 #include <string>
 #include <vector>
 #include <memory>
-#include <sstream>
 #include <cassert>
 #include <ctime>
 
-namespace logFormatHelper
-{
-    using namespace mylog;
-
-    /**
-     * @struct Item
-     * @brief Item抽象类代表格式化字符串中每个子项
-     */
-    struct Item
-    {
-        using ptr = std::shared_ptr<Item>;
-        // 将info中特定字段写进ostream中
-        virtual void getItem(std::ostream &os, const LogInfo &info) = 0;
-        virtual ~Item() {}
-    };
-
-    // Item抽象类的各个派生类，代表格式化字符串中的某个子项
-    // %t
-    struct TimeItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            std::string str = "";
-            time_t timestamp = info.timestamp;
-            tm *timeinfo = localtime(&timestamp);
-
-            if (timeinfo)
-            {
-                str += std::to_string(timeinfo->tm_year + 1900);
-                str += "-";
-                str += std::to_string(timeinfo->tm_mon + 1);
-                str += "-";
-                str += std::to_string(timeinfo->tm_mday);
-                str += " ";
-                str += std::to_string(timeinfo->tm_hour);
-                str += ":";
-                str += std::to_string(timeinfo->tm_min);
-                str += ":";
-                str += std::to_string(timeinfo->tm_sec);
-            }
-            os << str;
-
-            // const char *format = "%D-%H:%M:%S";
-            // time_t t = info.timestamp;
-            // struct tm lt;
-            // localtime_r(&t, &lt);
-            // char tmp[128];
-            // strftime(tmp, 127, format, &lt);
-            // os << tmp;
-        }
-    };
-
-    // %c
-    struct LevelItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << Level::toString(info.level);
-        }
-    };
-
-    // %n
-    struct LoggerNameItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << info.loggerName;
-        }
-    };
-
-    // %i
-    struct ThreadIDItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << info.tid;
-        }
-    };
-
-    // %f
-    struct FileItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << info.file;
-        }
-    };
-
-    // %l
-    struct LineItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << std::to_string(info.line);
-        }
-    };
-
-    // %m
-    struct MessageItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << info.message;
-        }
-    };
-
-    struct SpaceItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            std::string str = " ";
-            os << str;
-        }
-    };
-
-    struct TabItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            std::string str = "\t";
-            os << str;
-        }
-    };
-
-    struct NLineItem : public Item
-    {
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            std::string str = "\n";
-            os << str;
-        }
-    };
-
-    struct OtherItem : public Item
-    {
-        OtherItem(const std::string &str)
-            : _str(str)
-        {
-        }
-        virtual void getItem(std::ostream &os, const LogInfo &info)
-        {
-            os << _str;
-        }
-
-    private:
-        std::string _str;
-    };
-} // namespace logFormatHelper
-
 namespace mylog
 {
     const std::string DEFAULT_FORMAT = "[%t][%c][%n][%i][%f%S:%S%l]%T%m%N";
@@ -168,7 +19,7 @@ namespace mylog
      * @brief 格式化器，将日志信息按照指定的格式输出
      *
      * 规则如下：
-     *  %t: 时间
+     *  %t: 时间，精确到毫秒，如 2024-05-01 08:03:09.127
      *  %c: 日志等级
      *  %n: 日志器名称
      *   %i: 线程id
@@ -180,16 +31,21 @@ namespace mylog
      *   %N: 换行
      *   %%: %
      *   其他字符：原样输出
+     *
+     * 构造时把格式串编译成一组平铺的指令，相邻的原样字符(含%S %T %N %%)合并成一条LITERAL指令，
+     * 格式化时按顺序执行指令，没有虚函数调用，也不申请内存
      */
     class Formatter
     {
     public:
         using ptr = std::shared_ptr<Formatter>;
-        
+
         Formatter(const std::string &format = DEFAULT_FORMAT)
             : _format(format)
         {
-            assert(fillItems());
+            bool ok = fillItems();
+            assert(ok);
+            (void)ok;
         }
 
         /// @brief 运行格式化功能，提取日志信息各项要素按指定格式输出字符串
@@ -197,32 +53,119 @@ namespace mylog
         /// @return 格式化后的字符串
         std::string run(const LogInfo &info)
         {
-            std::stringstream ss;
-            this->run(ss, info);
-            return ss.str();
+            LogBuffer buf;
+            this->run(buf, info);
+            return std::string(buf.data(), buf.size());
         }
 
-        /// @brief 运行格式化功能，提取日志信息各项要素按指定格式输出到指定输出流
-        /// @param os 输出流对象
+        /// @brief 运行格式化功能，提取日志信息各项要素按指定格式追加到缓冲区
+        /// @param buf 日志缓冲区
         /// @param info 日志信息
-        /// @return 输出流对象
-        std::ostream &run(std::ostream &os, const LogInfo &info)
+        void run(LogBuffer &buf, const LogInfo &info)
         {
-            for (auto &it : _items)
-                it->getItem(os, info);
-            return os;
+            for (const Instr &ins : _instrs)
+            {
+                switch (ins.op)
+                {
+                case Op::LITERAL:
+                    buf.append(_literals.data() + ins.off, ins.len);
+                    break;
+                case Op::TIME:
+                    appendTime(buf, info);
+                    break;
+                case Op::LEVEL:
+                    buf.append(Level::toCString(info.level));
+                    break;
+                case Op::LOGGER:
+                    buf.append(info.loggerName);
+                    break;
+                case Op::TID:
+                    buf.appendUint(info.tid);
+                    break;
+                case Op::FILE_NAME:
+                    buf.append(info.file);
+                    break;
+                case Op::LINE:
+                    buf.appendUint(info.line);
+                    break;
+                case Op::MESSAGE:
+                    buf.append(info.message, info.messageLen);
+                    break;
+                }
+            }
         }
 
     private:
-        /// @brief 解析 _format 串，获得每个格式化Item，按顺序添加进 _items 里
+        /// @brief 输出 "YYYY-MM-DD HH:MM:SS.mmm"。
+        ///        秒及以上的部分每个线程缓存一份，秒数变化时才重新调用localtime_r生成
+        static void appendTime(LogBuffer &buf, const LogInfo &info)
+        {
+            struct DateCache
+            {
+                time_t sec = -1;
+                char text[32];
+                size_t len = 0;
+            };
+            static thread_local DateCache cache;
+            if (info.timestamp != cache.sec)
+            {
+                tm t;
+                if (localtime_r(&info.timestamp, &t) == nullptr)
+                    return;
+                cache.len = strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &t);
+                cache.sec = info.timestamp;
+            }
+            buf.append(cache.text, cache.len);
+            uint32_t ms = info.usec / 1000;
+            char frac[4] = {'.', (char)('0' + ms / 100), (char)('0' + ms / 10 % 10), (char)('0' + ms % 10)};
+            buf.append(frac, sizeof(frac));
+        }
+        /// @brief 解析 _format 串，编译成指令，按顺序添加进 _instrs 里
         /// @return  是否解析成功
         bool fillItems();
+        // 追加一段原样输出的字符，与前一条LITERAL指令相邻时合并
+        void addLiteral(const char *str, size_t len);
+        void addOp(uint8_t op);
 
     private:
-        std::string _format;                            // 格式化规则字符串 %d %p...
-        std::vector<logFormatHelper::Item::ptr> _items; // 按_format的规则按顺序存放每个项
+        // 格式化指令
+        enum Op : uint8_t
+        {
+            LITERAL = 0, // 原样输出 _literals[off, off+len)
+            TIME,        // %t
+            LEVEL,       // %c
+            LOGGER,      // %n
+            TID,         // %i
+            FILE_NAME,   // %f
+            LINE,        // %l
+            MESSAGE      // %m
+        };
+        struct Instr
+        {
+            uint8_t op;
+            uint32_t off;
+            uint32_t len;
+        };
+
+        std::string _format;          // 格式化规则字符串 %d %p...
+        std::string _literals;        // 所有原样输出的字符
+        std::vector<Instr> _instrs;   // 按_format的规则按顺序存放每条指令
     };
 
+    void Formatter::addLiteral(const char *str, size_t len)
+    {
+        if (!_instrs.empty() && _instrs.back().op == Op::LITERAL)
+            _instrs.back().len += len;
+        else
+            _instrs.push_back(Instr{Op::LITERAL, (uint32_t)_literals.size(), (uint32_t)len});
+        _literals.append(str, len);
+    }
+
+    void Formatter::addOp(uint8_t op)
+    {
+        _instrs.push_back(Instr{op, 0, 0});
+    }
+
     bool Formatter::fillItems()
     {
         int i = 0, n = _format.size();
@@ -230,11 +173,10 @@ namespace mylog
         {
             if (_format[i] != '%')
             {
-                std::string tmp = "";
+                int start = i;
                 while (i < n && _format[i] != '%')
-                    tmp += _format[i++];
-                _items.push_back(
-                    logFormatHelper::Item::ptr(new logFormatHelper::OtherItem(tmp)));
+                    ++i;
+                addLiteral(_format.data() + start, i - start);
             }
             else
             {
@@ -244,48 +186,37 @@ namespace mylog
                 switch (_format[i])
                 {
                 case 't':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::TimeItem()));
+                    addOp(Op::TIME);
                     break;
                 case 'c':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::LevelItem()));
+                    addOp(Op::LEVEL);
                     break;
                 case 'n':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::LoggerNameItem()));
+                    addOp(Op::LOGGER);
                     break;
                 case 'i':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::ThreadIDItem()));
+                    addOp(Op::TID);
                     break;
                 case 'f':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::FileItem()));
+                    addOp(Op::FILE_NAME);
                     break;
                 case 'l':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::LineItem()));
+                    addOp(Op::LINE);
                     break;
                 case 'm':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::MessageItem()));
+                    addOp(Op::MESSAGE);
                     break;
                 case 'S':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::SpaceItem()));
+                    addLiteral(" ", 1);
                     break;
                 case 'T':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::TabItem()));
+                    addLiteral("\t", 1);
                     break;
                 case 'N':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::NLineItem()));
+                    addLiteral("\n", 1);
                     break;
                 case '%':
-                    _items.push_back(
-                        logFormatHelper::Item::ptr(new logFormatHelper::OtherItem("%")));
+                    addLiteral("%", 1);
                     break;
                 default:
                     return false;
@@ -297,4 +228,4 @@ namespace mylog
     }
 }
 
-#endif
\ No newline at end of file
+#endif
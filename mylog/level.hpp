@@ -37,6 +37,27 @@ namespace mylog
                 return STRING(UNKNOWN);
             }
         }
+        // 不构造string的版本，格式化日志时使用
+        static const char *toCString(Level::Value lv)
+        {
+            switch (lv)
+            {
+            case Level::Value::DEBUG:
+                return STRING(DEBUG);
+            case Level::Value::INFO:
+                return STRING(INFO);
+            case Level::Value::WARN:
+                return STRING(WARN);
+            case Level::Value::ERROR:
+                return STRING(ERROR);
+            case Level::Value::FATAL:
+                return STRING(FATAL);
+            case Level::Value::OFF:
+                return STRING(OFF);
+            default:
+                return STRING(UNKNOWN);
+            }
+        }
     };
 }
 
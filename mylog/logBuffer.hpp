@@ -0,0 +1,136 @@
+#ifndef _LOGBUFFER_HPP_
+#define _LOGBUFFER_HPP_
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace mylog
+{
+    const size_t LOG_BUFFER_INIT_LEN = 4096; // 每个线程暂存缓冲区的初始大小
+
+    /**
+     * @brief 日志暂存缓冲区
+     *
+     *      每个线程持有自己的缓冲区(threadLocal)，日志直接格式化进缓冲区，
+     *      clear() 只重置写位置不释放空间，容量够用之后写日志不再申请内存
+     */
+    class LogBuffer
+    {
+    private:
+        std::vector<char> _space; // 缓冲区空间
+        size_t _wptr;             // 写位置
+
+    public:
+        LogBuffer(size_t len = LOG_BUFFER_INIT_LEN)
+            : _space(len), _wptr(0)
+        {
+        }
+        // 当前线程的暂存缓冲区，idx区分同一线程的多个缓冲区
+        template <int idx>
+        static LogBuffer &threadLocal()
+        {
+            static thread_local LogBuffer buf;
+            return buf;
+        }
+        void append(const char *data, size_t len)
+        {
+            ensure(len);
+            memcpy(&_space[_wptr], data, len);
+            _wptr += len;
+        }
+        void append(const char *str)
+        {
+            append(str, strlen(str));
+        }
+        void append(char c)
+        {
+            ensure(1);
+            _space[_wptr++] = c;
+        }
+        // 追加十进制整数，查两位数字表，不经过printf
+        void appendUint(uint64_t val)
+        {
+            static const char digits[] =
+                "0001020304050607080910111213141516171819"
+                "2021222324252627282930313233343536373839"
+                "4041424344454647484950515253545556575859"
+                "6061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+            char tmp[20];
+            char *p = tmp + sizeof(tmp);
+            while (val >= 100)
+            {
+                unsigned idx = (unsigned)(val % 100) * 2;
+                val /= 100;
+                *--p = digits[idx + 1];
+                *--p = digits[idx];
+            }
+            if (val >= 10)
+            {
+                unsigned idx = (unsigned)val * 2;
+                *--p = digits[idx + 1];
+                *--p = digits[idx];
+            }
+            else
+                *--p = (char)('0' + val);
+            append(p, tmp + sizeof(tmp) - p);
+        }
+        // 按printf格式追加，空间不够时扩容后重新格式化一次
+        void appendv(const char *format, va_list al)
+        {
+            va_list copy;
+            va_copy(copy, al);
+            int n = vsnprintf(&_space[_wptr], _space.size() - _wptr, format, copy);
+            va_end(copy);
+            if (n < 0)
+                return;
+            if ((size_t)n >= _space.size() - _wptr)
+            {
+                ensure(n + 1);
+                vsnprintf(&_space[_wptr], _space.size() - _wptr, format, al);
+            }
+            _wptr += n;
+        }
+        void appendf(const char *format, ...)
+        {
+            va_list al;
+            va_start(al, format);
+            appendv(format, al);
+            va_end(al);
+        }
+        // 覆盖已写入的内容，用于回填长度等字段
+        void overwrite(size_t pos, const char *data, size_t len)
+        {
+            memcpy(&_space[pos], data, len);
+        }
+        const char *data() const
+        {
+            return _space.data();
+        }
+        size_t size() const
+        {
+            return _wptr;
+        }
+        void clear()
+        {
+            _wptr = 0;
+        }
+
+    private:
+        // 保证还能写入len个字节
+        void ensure(size_t len)
+        {
+            if (_space.size() - _wptr >= len)
+                return;
+            size_t cap = _space.size() * 2;
+            while (cap - _wptr < len)
+                cap *= 2;
+            _space.resize(cap);
+        }
+    };
+}
+
+#endif
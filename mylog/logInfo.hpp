@@ -3,36 +3,50 @@
 
 #include "level.hpp"
 #include "util.hpp"
-#include <thread>
+#include <pthread.h>
 
 namespace mylog
 {
     /*
         定义日志信息的结构
-        这是日志输出时的各项信息
+        这是日志输出时的各项信息。
+        文件名、日志器名称、日志主体都只保存指针，指向的内容在格式化完成之前有效，构造时不拷贝字符串
     */
     struct LogInfo
     {
         Level::Value level;     // 日志等级
         time_t timestamp;       // 时间戳，精确到秒
+        uint32_t usec;          // 时间戳秒以下的部分，微秒
         size_t line;            // 行号
-        std::thread::id tid;    // 线程ID
-        std::string file;       // 文件名
-        std::string loggerName; // 日志器名称
-        std::string message;    // 日志主体消息
+        unsigned long tid;      // 线程ID
+        const char *file;       // 文件名，一般是__FILE__
+        const char *loggerName; // 日志器名称
+        const char *message;    // 日志主体消息，不以'\0'结尾
+        size_t messageLen;      // 日志主体消息长度
 
         // 构造函数
-        LogInfo(const Level::Value& level_, const std::string& loggerName_,
-        const std::string& file_, size_t line_,const std::string& message_)
+        LogInfo(const Level::Value& level_, const char* loggerName_,
+        const char* file_, size_t line_, const char* message_, size_t messageLen_)
             :level(level_)
-            ,timestamp(TimeUtil::getTime())
             ,line(line_)
-            ,tid(std::this_thread::get_id())
+            ,tid(threadId())
             ,file(file_)
             ,loggerName(loggerName_)
             ,message(message_)
-        {}
+            ,messageLen(messageLen_)
+        {
+            int64_t us = TimeUtil::getTimeUs();
+            timestamp = (time_t)(us / 1000000);
+            usec = (uint32_t)(us % 1000000);
+        }
+
+        // 当前线程的ID，与std::thread::id输出到流中的值相同
+        static unsigned long threadId()
+        {
+            static thread_local unsigned long tid = (unsigned long)pthread_self();
+            return tid;
+        }
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -11,10 +11,12 @@
 #include "logInfo.hpp"
 #include "format.hpp"
 #include "asyncLoggerCtrl.hpp"
+#include "binLog.hpp"
 #include <unordered_map>
 #include <atomic>
 #include <mutex>
 #include <cstdarg>
+#include <algorithm>
 
 namespace mylog
 {
@@ -27,7 +29,8 @@ namespace mylog
         enum class Type
         {
             SYNC = 0, // 同步日志器
-            ASYNC     // 异步日志器
+            ASYNC,    // 异步日志器
+            BINARY    // 二进制异步日志器，见 binLog.hpp
         };
 
     protected:
@@ -59,10 +62,10 @@ namespace mylog
             // 1.组织日志消息
             va_list al;
             va_start(al, format);
-            std::string message = organizeMessage(lv, file, line, format, al);
+            LogBuffer &message = organizeMessage(lv, file, line, format, al);
             va_end(al);
             // 2.日志消息输出
-            outPut(message);
+            outPut(message.data(), message.size());
         }
         /// @brief 把 INFO 等级的日志消息输出
         /// @param file 当前文件名
@@ -78,10 +81,10 @@ namespace mylog
             // 1.组织日志消息
             va_list al;
             va_start(al, format);
-            std::string message = organizeMessage(lv, file, line, format, al);
+            LogBuffer &message = organizeMessage(lv, file, line, format, al);
             va_end(al);
             // 2.日志消息输出
-            outPut(message);
+            outPut(message.data(), message.size());
         }
         /// @brief 把 WARN 等级的日志消息输出
         /// @param file 当前文件名
@@ -97,10 +100,10 @@ namespace mylog
             // 1.组织日志消息
             va_list al;
             va_start(al, format);
-            std::string message = organizeMessage(lv, file, line, format, al);
+            LogBuffer &message = organizeMessage(lv, file, line, format, al);
             va_end(al);
             // 2.日志消息输出
-            outPut(message);
+            outPut(message.data(), message.size());
         }
         /// @brief 把 ERROR 等级的日志消息输出
         /// @param file 当前文件名
@@ -116,10 +119,10 @@ namespace mylog
             // 1.组织日志消息
             va_list al;
             va_start(al, format);
-            std::string message = organizeMessage(lv, file, line, format, al);
+            LogBuffer &message = organizeMessage(lv, file, line, format, al);
             va_end(al);
             // 2.日志消息输出
-            outPut(message);
+            outPut(message.data(), message.size());
         }
         /// @brief 把 FATAL 等级的日志消息输出
         /// @param file 当前文件名
@@ -135,10 +138,16 @@ namespace mylog
             // 1.组织日志消息
             va_list al;
             va_start(al, format);
-            std::string message = organizeMessage(lv, file, line, format, al);
+            LogBuffer &message = organizeMessage(lv, file, line, format, al);
             va_end(al);
             // 2.日志消息输出
-            outPut(message);
+            outPut(message.data(), message.size());
+        }
+
+        /// @brief 当前等级是否会被输出，只读一次原子变量，供日志宏在求值参数之前判断
+        bool enabled(Level::Value lv) const
+        {
+            return lv >= _minLevel.load(std::memory_order_relaxed);
         }
 
     protected:
@@ -151,40 +160,38 @@ namespace mylog
         }
 
         /// @brief 提取日志有效信息并构造日志信息，返回格式化后的日志消息
+        ///
+        ///         日志主体和格式化结果都写在当前线程的暂存缓冲区中，不申请内存，
+        ///         返回的缓冲区在当前线程下一次写日志之前有效
         /// @param lv 当前等级
         /// @param file 当前文件名
         /// @param line 当前行号
         /// @param format 日志有效载荷的格式，与printf一样
         /// @param al 不定参数列表
         /// @return 格式化后的日志消息
-        std::string organizeMessage(const Level::Value &lv, const char *file, size_t line, const char *format, va_list al)
+        LogBuffer &organizeMessage(const Level::Value &lv, const char *file, size_t line, const char *format, va_list al)
         {
             // 1.提取出不定参中的日志有效载荷到message中
-            char *buf;
-            std::string message;
-            int n = vasprintf(&buf, format, al);
-            if (n < 0)
-            {
-                message = "Get log message failed.\n";
-            }
-            else
-            {
-                message.assign(buf, n);
-                free(buf);
-            }
+            LogBuffer &message = LogBuffer::threadLocal<0>();
+            message.clear();
+            message.appendv(format, al);
             // 2.构造日志信息对象
-            LogInfo info(lv, _name, file, line, message);
+            LogInfo info(lv, _name.c_str(), file, line, message.data(), message.size());
 
-            // 3.调用Formatter格式化日志信息并返回
-            return _formatter->run(info);
+            // 3.调用Formatter格式化日志信息到另一个缓冲区并返回
+            LogBuffer &out = LogBuffer::threadLocal<1>();
+            out.clear();
+            _formatter->run(out, info);
+            return out;
         }
 
         /// @brief 把日志消息输出的函数。具体如何输出，由派生的日志器类决定
         ///
         ///         同步日志器：将日志消息直接输出到指定的sinkers中
         ///         异步日志器：将日志消息放入缓冲区，缓冲区中的日志消息由其他线程处理输出
-        /// @param message 格式化后的日志消息
-        virtual void outPut(const std::string &message) = 0;
+        /// @param data 格式化后的日志消息
+        /// @param len 日志消息长度
+        virtual void outPut(const char *data, size_t len) = 0;
     };
 
     /**
@@ -199,13 +206,14 @@ namespace mylog
         }
 
         /// @brief 把日志消息直接输出到指定的sinkers中。
-        /// @param message 格式化后的日志消息
-        virtual void outPut(const std::string &message) override
+        /// @param data 格式化后的日志消息
+        /// @param len 日志消息长度
+        virtual void outPut(const char *data, size_t len) override
         {
             std::unique_lock<std::mutex> lock(_mutex);
             if (!_sinkers.empty())
                 for (auto &sinker : _sinkers)
-                    sinker->run(message.c_str(), message.size());
+                    sinker->run(data, len);
             else
             {
                 std::cout << "sinkers为空\n";
@@ -216,26 +224,151 @@ namespace mylog
     /// @brief 异步日志器，继承Logger类
     class AsyncLogger : public Logger
     {
-    private:
+    protected:
         AsyncLoggerCtrl::ptr _ctrl;
 
     public:
-        AsyncLogger(const std::string &name, Level::Value minLevel, Formatter::ptr formatter, std::vector<Sinker::ptr> sinkers)
-            : _ctrl(std::make_shared<AsyncLoggerCtrl>(std::bind(&AsyncLogger::sink, this, std::placeholders::_1))), Logger(name, minLevel, formatter, sinkers)
+        AsyncLogger(const std::string &name, Level::Value minLevel, Formatter::ptr formatter, std::vector<Sinker::ptr> sinkers,
+                    const OverflowOptions &overflow = OverflowOptions())
+            : _ctrl(std::make_shared<AsyncLoggerCtrl>(std::bind(&AsyncLogger::sink, this, std::placeholders::_1, std::placeholders::_2),
+                                                      std::bind(&AsyncLogger::flush, this), overflow)),
+              Logger(name, minLevel, formatter, sinkers)
+        {
+        }
+        /// @brief 缓冲区溢出的统计：等待、丢弃、进入溢出队列、截断的次数
+        OverflowStats overflowStats() const
         {
+            return _ctrl->stats();
         }
 
     private:
-        virtual void outPut(const std::string &message) override
+        virtual void outPut(const char *data, size_t len) override
         {
             // 直接往缓冲区放，日志的落地由异步工作线程完成
-            _ctrl->push(message);
+            _ctrl->push(data, len);
         }
-        void sink(AsyncLoggerCharBuf &logMsg)
+        // 由后台线程调用，一批日志一次交给每个sinker
+        void sink(const struct iovec *iov, int cnt)
         {
             if (!_sinkers.empty())
                 for (auto &sinker : _sinkers)
-                    sinker->run(logMsg.readBegin(), logMsg.readEnd());
+                    sinker->runv(iov, cnt);
+        }
+        void flush()
+        {
+            for (auto &sinker : _sinkers)
+                sinker->flush();
+        }
+    };
+
+    /// @brief 二进制异步日志器，继承AsyncLogger类
+    ///
+    ///         通过 BIN_INFO_LOG 等宏写日志时不做格式化，只把调用点id、时间戳、线程id和参数的原始字节
+    ///         放入异步缓冲区，每个调用点的格式串只在第一次使用时写入一次，由 binDecode 工具还原成文本。
+    ///         sinker切分出新文件时，已经写过的定义作为文件头重新写入新文件。
+    ///         普通的 info() 等接口仍然可用，格式化后的文本作为 'T' 记录写入
+    class BinaryLogger : public AsyncLogger
+    {
+    private:
+        std::unique_ptr<std::atomic<bool>[]> _defined; // 调用点的定义是否已经写入
+        std::unique_ptr<std::atomic<bool>[]> _queued;  // 调用点的定义是否已经开始写入，文件头包含这些定义
+        std::mutex _defineMtx;
+
+    public:
+        BinaryLogger(const std::string &name, Level::Value minLevel, Formatter::ptr formatter, std::vector<Sinker::ptr> sinkers,
+                     const OverflowOptions &overflow = OverflowOptions())
+            : AsyncLogger(name, minLevel, formatter, sinkers, overflow), _defined(new std::atomic<bool>[binlog::MAX_SITES]),
+              _queued(new std::atomic<bool>[binlog::MAX_SITES])
+        {
+            for (size_t i = 0; i < binlog::MAX_SITES; ++i)
+            {
+                _defined[i].store(false, std::memory_order_relaxed);
+                _queued[i].store(false, std::memory_order_relaxed);
+            }
+            for (auto &sinker : _sinkers)
+                sinker->setHeader(std::bind(&BinaryLogger::header, this, std::placeholders::_1));
+        }
+        ~BinaryLogger()
+        {
+            // 先写完剩余的日志，期间仍然可能切分文件、用到文件头；之后sinker不再引用本对象
+            _ctrl.reset();
+            for (auto &sinker : _sinkers)
+                sinker->setHeader(nullptr);
+        }
+
+        /// @brief 写入一条二进制日志，由 BIN_*_LOG 宏调用
+        /// @param id 调用点id
+        /// @param args 日志参数
+        template <typename... Args>
+        void logBinary(uint32_t id, const Args &...args)
+        {
+            if (id >= binlog::MAX_SITES)
+                return;
+            if (!_defined[id].load(std::memory_order_acquire))
+                define(id);
+            LogBuffer &buf = LogBuffer::threadLocal<2>();
+            binlog::encodeRecord(buf, id, TimeUtil::getTimeUs(), LogInfo::threadId(), args...);
+            push(buf);
+        }
+
+    private:
+        // 二进制记录被截断后无法解码，超长的记录直接丢弃
+        void push(const LogBuffer &buf)
+        {
+            if (buf.size() > AsyncLoggerRing::maxMessageSize())
+                _ctrl->discard();
+            else
+                _ctrl->push(buf.data(), buf.size());
+        }
+        virtual void outPut(const char *data, size_t len) override
+        {
+            LogBuffer &buf = LogBuffer::threadLocal<2>();
+            binlog::beginRecord(buf, 'T');
+            buf.append(data, len);
+            binlog::endRecord(buf);
+            push(buf);
+        }
+        // 写入调用点定义。先写入定义再设置标志，其他线程看到标志时，定义一定已经在缓冲区中排在前面
+        void define(uint32_t id)
+        {
+            std::unique_lock<std::mutex> lock(_defineMtx);
+            if (_defined[id].load(std::memory_order_relaxed))
+                return;
+            LogBuffer &buf = LogBuffer::threadLocal<2>();
+            encodeDefine(buf, id);
+            // 在放入缓冲区之前标记：后台线程写出这条定义之后再切分文件，一定能看到标记
+            _queued[id].store(true, std::memory_order_release);
+            // 定义丢失后该调用点的所有记录都无法解码，不受溢出策略影响
+            _ctrl->push(buf.data(), buf.size(), true);
+            _defined[id].store(true, std::memory_order_release);
+        }
+        // 切分出新文件时由sinker在写日志的线程中调用，重新写入所有已经开始写入的定义。
+        // 还在缓冲区中没写出的定义之后会再写一次，重复的定义不影响解码
+        void header(LogBuffer &out)
+        {
+            LogBuffer &buf = LogBuffer::threadLocal<2>();
+            for (uint32_t id = 0; id < binlog::MAX_SITES; ++id)
+                if (_queued[id].load(std::memory_order_acquire))
+                {
+                    encodeDefine(buf, id);
+                    out.append(buf.data(), buf.size());
+                }
+        }
+        void encodeDefine(LogBuffer &buf, uint32_t id)
+        {
+            binlog::Site site = binlog::Registry::instance().get(id);
+            binlog::beginRecord(buf, 'D');
+            binlog::put<uint32_t>(buf, id);
+            buf.append((char)site.level);
+            binlog::put<uint32_t>(buf, (uint32_t)site.line);
+            const char *strs[3] = {site.file, _name.c_str(), site.format};
+            for (const char *str : strs)
+            {
+                uint16_t n = (uint16_t)std::min(strlen(str), (size_t)UINT16_MAX);
+                binlog::put<uint16_t>(buf, n);
+                buf.append(str, n);
+            }
+            binlog::endRecord(buf);
         }
     };
 
@@ -247,6 +380,7 @@ namespace mylog
         Level::Value _minLevel;            // 日志器最低输出等级
         Formatter::ptr _formatter;         // 格式化器
         std::vector<Sinker::ptr> _sinkers; // 日志器的多个日志落地方向
+        OverflowOptions _overflow;         // 异步日志器缓冲区写满时的处理策略
 
     protected:
         LoggerBuilder()
@@ -269,6 +403,11 @@ namespace mylog
         {
             _type = type;
         }
+        /// @brief 设置异步日志器缓冲区写满时的处理策略，同步日志器忽略
+        void setOverflow(const OverflowOptions &overflow)
+        {
+            _overflow = overflow;
+        }
         void setFormatter(const std::string &fmt = DEFAULT_FORMAT)
         {
             _formatter = std::make_shared<Formatter>(fmt);
@@ -305,8 +444,10 @@ namespace mylog
             Logger::ptr lp;
             if (_type == Logger::Type::ASYNC)
             {
-                lp = std::make_shared<AsyncLogger>(_name, _minLevel, _formatter, _sinkers);
+                lp = std::make_shared<AsyncLogger>(_name, _minLevel, _formatter, _sinkers, _overflow);
             }
+            else if (_type == Logger::Type::BINARY)
+                lp = std::make_shared<BinaryLogger>(_name, _minLevel, _formatter, _sinkers, _overflow);
             else
                 lp = std::make_shared<SyncLogger>(_name, _minLevel, _formatter, _sinkers);
             return lp;
@@ -394,8 +535,10 @@ namespace mylog
             Logger::ptr lp;
             if (_type == Logger::Type::ASYNC)
             {
-                lp = std::make_shared<AsyncLogger>(_name, _minLevel, _formatter, _sinkers);
+                lp = std::make_shared<AsyncLogger>(_name, _minLevel, _formatter, _sinkers, _overflow);
             }
+            else if (_type == Logger::Type::BINARY)
+                lp = std::make_shared<BinaryLogger>(_name, _minLevel, _formatter, _sinkers, _overflow);
             else
                 lp = std::make_shared<SyncLogger>(_name, _minLevel, _formatter, _sinkers);
             LoggerManager::getInstance().add(_name, lp);
@@ -1,6 +1,10 @@
 #ifndef _MYLOG_H_
 #define _MYLOG_H_
 #include "logger.hpp"
+
+#ifndef MYLOG_COMPILE_LEVEL
+#define MYLOG_COMPILE_LEVEL 0
+#endif
 namespace mylog
 {
     Logger::ptr getLogger(const std::string &name)
@@ -11,6 +15,23 @@ namespace mylog
     {
         return LoggerManager::getInstance().defaultConsoleLogger();
     }
+    /// 获取二进制日志器，不存在或不是二进制日志器时返回nullptr。日志器由LoggerManager持有，指针一直有效
+    BinaryLogger *getBinaryLogger(const std::string &name)
+    {
+        return dynamic_cast<BinaryLogger *>(getLogger(name).get());
+    }
+    /// 默认日志器的裸指针。默认日志器随LoggerManager一直存在，第一次调用后缓存，之后不再加锁
+    inline Logger *defaultLoggerRaw()
+    {
+        static Logger *logger = LoggerManager::getInstance().defaultConsoleLogger().get();
+        return logger;
+    }
+    /// 默认日志器是否输出lv等级的日志，编译期等级不够时恒为false
+    template <Level::Value lv>
+    inline bool logEnabled()
+    {
+        return (int)lv >= MYLOG_COMPILE_LEVEL && defaultLoggerRaw()->enabled(lv);
+    }
 
 #define debug_log(fmt, ...) debug(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
 #define info_log(fmt, ...) info(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
@@ -18,11 +39,22 @@ namespace mylog
 #define error_log(fmt, ...) error(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
 #define fatal_log(fmt, ...) fatal(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
-#define DEBUG_LOG(fmt, ...) defaultLogger()->debug_log(fmt, ##__VA_ARGS__)
-#define INFO_LOG(fmt, ...) defaultLogger()->info_log(fmt, ##__VA_ARGS__)
-#define WARN_LOG(fmt, ...) defaultLogger()->warn_log(fmt, ##__VA_ARGS__)
-#define ERROR_LOG(fmt, ...) defaultLogger()->error_log(fmt, ##__VA_ARGS__)
-#define FATAL_LOG(fmt, ...) defaultLogger()->fatal_log(fmt, ##__VA_ARGS__)
+/*
+    全局日志宏，用法与printf相同：mylog::INFO_LOG("uid: %lu", uid)
+    - 低于 MYLOG_COMPILE_LEVEL 的日志在编译期被去掉，参数也不会被求值
+    - 其余日志先用缓存的日志器指针做一次原子的等级判断，不加锁、不拷贝shared_ptr，
+      等级不够时参数同样不会被求值
+    MYLOG_COMPILE_LEVEL 取值与 Level::Value 相同：0 DEBUG, 1 INFO, 2 WARN, 3 ERROR, 4 FATAL, 5 OFF，
+    需要在包含本文件之前定义，或通过 -DMYLOG_COMPILE_LEVEL=1 指定
+*/
+#define MYLOG_LOG_IF(lv, func, fmt, ...) \
+    logEnabled< lv >() ? ::mylog::defaultLoggerRaw()->func(__FILE__, __LINE__, fmt, ##__VA_ARGS__) : (void)0
+
+#define DEBUG_LOG(fmt, ...) MYLOG_LOG_IF(::mylog::Level::Value::DEBUG, debug, fmt, ##__VA_ARGS__)
+#define INFO_LOG(fmt, ...) MYLOG_LOG_IF(::mylog::Level::Value::INFO, info, fmt, ##__VA_ARGS__)
+#define WARN_LOG(fmt, ...) MYLOG_LOG_IF(::mylog::Level::Value::WARN, warn, fmt, ##__VA_ARGS__)
+#define ERROR_LOG(fmt, ...) MYLOG_LOG_IF(::mylog::Level::Value::ERROR, error, fmt, ##__VA_ARGS__)
+#define FATAL_LOG(fmt, ...) MYLOG_LOG_IF(::mylog::Level::Value::FATAL, fatal, fmt, ##__VA_ARGS__)
 } // namespace mylog
 
 #endif
\ No newline at end of file
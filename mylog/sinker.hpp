@@ -2,8 +2,26 @@
 #define _SINKER_HPP_
 
 #include "util.hpp"
+#include "logBuffer.hpp"
+#include "uring.hpp"
 #include <memory>
 #include <cassert>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
 
 namespace mylog
 {
@@ -15,7 +33,23 @@ namespace mylog
     {
     public:
         using ptr = std::shared_ptr<Sinker>;
+        using header_func_t = std::function<void(LogBuffer &buf)>;
         virtual bool run(const char *message, size_t size) = 0;
+        /// @brief 一次写入一批日志，异步日志器的后台线程使用。
+        ///        默认拼接到当前线程的缓冲区后调用一次run，能直接写文件描述符的sinker应改用writev
+        virtual bool runv(const struct iovec *iov, int cnt)
+        {
+            LogBuffer &buf = LogBuffer::threadLocal<3>();
+            buf.clear();
+            for (int i = 0; i < cnt; ++i)
+                buf.append((const char *)iov[i].iov_base, iov[i].iov_len);
+            return run(buf.data(), buf.size());
+        }
+        /// @brief 异步日志器的后台线程定期调用，用于按时间同步数据
+        virtual void flush() {}
+        /// @brief 设置文件头：切分出新文件后、写入后续日志之前，调用header填写要写在新文件开头的内容。
+        ///        只有会切分文件的sinker使用，其他sinker忽略
+        virtual void setHeader(header_func_t) {}
         virtual ~Sinker() {}
     };
 
@@ -33,9 +67,18 @@ namespace mylog
         }
     };
 
+    /// @brief 文件落盘策略
+    enum class SyncPolicy
+    {
+        NONE = 0,   // 只写入内核，由系统决定何时落盘
+        PERIODIC,   // 写入后距离上次同步超过 syncIntervalMs 时调用fdatasync，空闲时由后台线程补上
+        EVERY_BATCH // 每次写入(异步日志器为每一批)后调用fdatasync
+    };
+
     /**
      * @brief 文件日志落地器，负责将日志消息输出到指定文件
      *
+     *      直接写文件描述符，不经过用户态缓冲：run() 一次write，runv() 一批日志一次writev
      */
     class FileSinker : public Sinker
     {
@@ -43,8 +86,8 @@ namespace mylog
         // "./path/to/file"
         // "/path/to/file"
         // 提取路径，如果实际没有路径的话要创建路径
-        FileSinker(const std::string &file)
-            : _file(file)
+        FileSinker(const std::string &file, SyncPolicy sync = SyncPolicy::NONE, size_t syncIntervalMs = 1000)
+            : _file(file), _sync(sync), _syncIntervalMs(syncIntervalMs), _dirty(false), _lastSync(std::chrono::steady_clock::now())
         {
             // 在打开文件之前，要创建目录，因为可能目录不存在
             if(!FileUtil::exists(FileUtil::getPath(_file)))
@@ -53,36 +96,589 @@ namespace mylog
             }
 
             // 以追加方式打开文件
-            _ofs.open(_file, std::ios::binary | std::ios::app);
-            assert(_ofs.is_open());
+            _fd = openFile();
         }
         ~FileSinker()
         {
-            // Note that any open file is automatically closed when the ofstream object is destroyed.
-            // if(_ofs.is_open())
-                // _ofs.close();
+            if (_dirty)
+                fdatasync(_fd);
+            close(_fd);
         }
 
 
         virtual bool run(const char* message, size_t size)
         {
-            _ofs.write(message, size);
-            return _ofs.good();
+            struct iovec iov = {(void *)message, size};
+            return runv(&iov, 1);
+        }
+        virtual bool runv(const struct iovec *iov, int cnt)
+        {
+            bool ok = writeAll(iov, cnt);
+            if (_sync == SyncPolicy::EVERY_BATCH)
+                fdatasync(_fd);
+            else if (_sync == SyncPolicy::PERIODIC)
+            {
+                _dirty = true;
+                flush();
+            }
+            return ok;
+        }
+        virtual void flush()
+        {
+            if (!syncDue())
+                return;
+            fdatasync(_fd);
+            _dirty = false;
+            _lastSync = std::chrono::steady_clock::now();
         }
 
 
-    private:
+    protected:
+        // PERIODIC 下是否到了同步的时间
+        bool syncDue() const
+        {
+            return _dirty && std::chrono::steady_clock::now() - _lastSync >= std::chrono::milliseconds(_syncIntervalMs);
+        }
+        int openFile()
+        {
+            int fd = open(_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            assert(fd >= 0);
+            return fd;
+        }
+        // 关闭并重新打开 _file，用于切分文件。PERIODIC 下还没同步的数据在关闭前同步
+        void reopen()
+        {
+            if (_dirty)
+            {
+                fdatasync(_fd);
+                _dirty = false;
+                _lastSync = std::chrono::steady_clock::now();
+            }
+            close(_fd);
+            _fd = openFile();
+        }
+        // 写完所有数据，处理部分写入和被信号打断的情况
+        bool writeAll(const struct iovec *iov, int cnt)
+        {
+            struct iovec local[IOV_MAX];
+            while (cnt > 0)
+            {
+                int n = std::min(cnt, (int)IOV_MAX);
+                std::copy(iov, iov + n, local);
+                struct iovec *cur = local;
+                int left = n;
+                while (left > 0)
+                {
+                    ssize_t ret = writev(_fd, cur, left);
+                    if (ret < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        return false;
+                    }
+                    // 跳过已经写完的段，调整写了一部分的段
+                    while (left > 0 && (size_t)ret >= cur->iov_len)
+                    {
+                        ret -= cur->iov_len;
+                        ++cur;
+                        --left;
+                    }
+                    if (left > 0)
+                    {
+                        cur->iov_base = (char *)cur->iov_base + ret;
+                        cur->iov_len -= ret;
+                    }
+                }
+                iov += n;
+                cnt -= n;
+            }
+            return true;
+        }
+
+    protected:
         std::string _file;
-        std::ofstream _ofs; // 写入文件的句柄
+        int _fd;                                         // 文件描述符
+        SyncPolicy _sync;                                // 落盘策略
+        size_t _syncIntervalMs;                          // PERIODIC 的同步间隔
+        bool _dirty;                                     // 上次同步之后是否有写入
+        std::chrono::steady_clock::time_point _lastSync; // 上次同步的时间
+    };
+
+    /**
+     * @brief 通过io_uring写文件的日志落地器
+     *
+     *      runv() 把一批日志拷贝到注册给内核的固定缓冲区，提交 IORING_OP_WRITE_FIXED 后立即返回，
+     *      后台线程不等待磁盘写完就可以处理下一批日志：
+     *      1.共有 depth 个缓冲区，同时在写的最多 depth 个，没有空闲缓冲区时才等待最早的一次写完成
+     *      2.每次写入都指定文件偏移，多个写入同时进行也不会乱序。因此不能有其他进程同时追加同一个文件
+     *      3.内核写入出错或只写了一部分时，剩余部分用pwrite补写
+     *      4.内核不支持io_uring(或被禁用)时，退回 FileSinker 的writev
+     *      SyncPolicy 与 FileSinker 相同，同步前先等待所有在写的缓冲区完成
+     */
+    class UringFileSinker : public FileSinker
+    {
+    public:
+        /// @param file 日志文件
+        /// @param sync 落盘策略
+        /// @param syncIntervalMs PERIODIC 的同步间隔
+        /// @param bufferSize 每个缓冲区的大小
+        /// @param depth 缓冲区个数，即同时在写的最大个数
+        UringFileSinker(const std::string &file, SyncPolicy sync = SyncPolicy::NONE, size_t syncIntervalMs = 1000,
+                        size_t bufferSize = 1024 * 1024, unsigned depth = 4)
+            : FileSinker(file, sync, syncIntervalMs), _bufferSize(bufferSize), _depth(depth), _ok(false), _fixed(false),
+              _space(bufferSize * depth), _bufs(depth), _busy(depth, false), _offs(depth, 0), _cur(0), _curLen(0), _inflight(0), _offset(0)
+        {
+            if (_depth == 0 || !_uring.init(_depth))
+            {
+                std::cout << "io_uring不可用，" << _file << " 改用writev写入\n";
+                return;
+            }
+            for (unsigned i = 0; i < _depth; ++i)
+            {
+                _bufs[i].iov_base = &_space[i * _bufferSize];
+                _bufs[i].iov_len = _bufferSize;
+            }
+            _fixed = _uring.registerBuffers(_bufs.data(), _depth);
+            // 按偏移写入，去掉O_APPEND，否则内核会忽略偏移
+            int flags = fcntl(_fd, F_GETFL);
+            off_t end = lseek(_fd, 0, SEEK_END);
+            if (flags < 0 || end < 0 || fcntl(_fd, F_SETFL, flags & ~O_APPEND) != 0)
+                return;
+            _offset = end;
+            _ok = true;
+        }
+        ~UringFileSinker()
+        {
+            waitAll();
+        }
+
+        virtual bool runv(const struct iovec *iov, int cnt)
+        {
+            if (!_ok)
+                return FileSinker::runv(iov, cnt);
+            // 中途退回writev时，剩下的日志仍然先拷贝到缓冲区，由submitCurrent同步写出
+            reap(false);
+            for (int i = 0; i < cnt; ++i)
+            {
+                const char *data = (const char *)iov[i].iov_base;
+                size_t len = iov[i].iov_len;
+                while (len > 0)
+                {
+                    size_t n = std::min(len, _bufferSize - _curLen);
+                    memcpy((char *)_bufs[_cur].iov_base + _curLen, data, n);
+                    _curLen += n;
+                    data += n;
+                    len -= n;
+                    if (_curLen == _bufferSize)
+                        submitCurrent();
+                }
+            }
+            if (_curLen > 0)
+                submitCurrent();
+            if (_sync == SyncPolicy::EVERY_BATCH)
+            {
+                waitAll();
+                fdatasync(_fd);
+            }
+            else if (_sync == SyncPolicy::PERIODIC)
+            {
+                _dirty = true;
+                flush();
+            }
+            return true;
+        }
+        virtual void flush()
+        {
+            if (!_ok)
+                return FileSinker::flush();
+            reap(false);
+            // 到了同步时间才等待在写的缓冲区，否则runv每次都会等到写完，失去异步写入的意义
+            if (_sync == SyncPolicy::PERIODIC && syncDue())
+            {
+                waitAll();
+                FileSinker::flush();
+            }
+        }
+
+    private:
+        // 提交当前缓冲区，再取一个空闲缓冲区，没有空闲的就等待
+        void submitCurrent()
+        {
+            if (_ok)
+            {
+                struct io_uring_sqe *sqe = _uring.getSqe();
+                while (sqe == nullptr)
+                {
+                    reap(true);
+                    sqe = _uring.getSqe();
+                }
+                sqe->opcode = _fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe->fd = _fd;
+                sqe->addr = (uint64_t)(uintptr_t)_bufs[_cur].iov_base;
+                sqe->len = (uint32_t)_curLen;
+                sqe->off = _offset;
+                sqe->buf_index = _fixed ? (uint16_t)_cur : 0;
+                sqe->user_data = _cur;
+                if (_uring.submit() >= 0)
+                {
+                    _busy[_cur] = true;
+                    _offs[_cur] = _offset;
+                    _bufs[_cur].iov_len = _curLen;
+                    _offset += _curLen;
+                    ++_inflight;
+                    _curLen = 0;
+                    nextBuffer();
+                    return;
+                }
+                // 提交失败后不再调用io_uring，等在写的完成后恢复O_APPEND，退回writev
+                std::cout << "io_uring提交失败，" << _file << " 改用writev写入\n";
+                waitAll();
+                _ok = false;
+                int flags = fcntl(_fd, F_GETFL);
+                fcntl(_fd, F_SETFL, flags | O_APPEND);
+            }
+            struct iovec iov = {_bufs[_cur].iov_base, _curLen};
+            writeAll(&iov, 1);
+            _curLen = 0;
+        }
+        // 选一个空闲的缓冲区继续填充，都在写时等待
+        void nextBuffer()
+        {
+            while (true)
+            {
+                for (unsigned i = 0; i < _depth; ++i)
+                    if (!_busy[i])
+                    {
+                        _cur = i;
+                        return;
+                    }
+                reap(true);
+            }
+        }
+        // 处理完成项，wait为true时至少等待一个
+        void reap(bool wait)
+        {
+            if (wait && _inflight > 0 && _uring.submit(1) < 0)
+                std::this_thread::yield();
+            uint64_t idx;
+            int res;
+            while (_uring.peekCqe(idx, res))
+                complete((unsigned)idx, res);
+        }
+        // 一个缓冲区写完。出错或只写了一部分时同步补写剩余部分
+        void complete(unsigned idx, int res)
+        {
+            if (idx >= _depth || !_busy[idx])
+                return;
+            size_t len = _bufs[idx].iov_len;
+            size_t done = res > 0 ? (size_t)res : 0;
+            while (done < len)
+            {
+                ssize_t n = pwrite(_fd, (char *)_bufs[idx].iov_base + done, len - done, _offs[idx] + done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                done += n;
+            }
+            _bufs[idx].iov_len = _bufferSize;
+            _busy[idx] = false;
+            --_inflight;
+        }
+        // 等待所有在写的缓冲区完成
+        void waitAll()
+        {
+            while (_inflight > 0)
+                reap(true);
+        }
+
+    private:
+        IoUring _uring;
+        size_t _bufferSize;
+        unsigned _depth;
+        bool _ok;                       // io_uring是否可用，不可用时退回writev
+        bool _fixed;                    // 缓冲区是否注册成功，没有注册时用普通的 IORING_OP_WRITE
+        std::vector<char> _space;       // 所有缓冲区的空间
+        std::vector<struct iovec> _bufs; // 每个缓冲区的地址，在写时iov_len为写入长度
+        std::vector<bool> _busy;        // 缓冲区是否在写
+        std::vector<off_t> _offs;       // 缓冲区写入的文件偏移
+        unsigned _cur;                  // 正在填充的缓冲区
+        size_t _curLen;                 // 正在填充的缓冲区已有的长度
+        unsigned _inflight;             // 在写的缓冲区个数
+        off_t _offset;                  // 下一次写入的文件偏移
     };
 
     /**
-     * @brief 日期文件日志落地器，负责将日志消息输出到以日期分类的文件
+     * @brief 滚动文件日志落地器，按大小和/或时间间隔切分日志文件
      *
+     *      在 FileSinker 的基础上增加切分，写入方式(writev)和落盘策略与 FileSinker 相同。
+     *      当前文件始终是 file，切分时把它重命名为 file.YYYYmmdd-HHMMSS 后重新打开 file：
+     *      1.写入前检查，进入了新的时间间隔就先切分；一批日志写入后会超过 maxBytes 时，
+     *        在两条日志(iovec)之间拆开，后面的部分写入新文件。一条日志不会被拆到两个文件里，
+     *        单条就超过上限的日志整条写入一个文件
+     *      2.重命名和重新打开在写日志的线程中完成，只是几次系统调用，不会阻塞生产者
+     *      3.最多保留 keep 个切分出来的旧文件，更早的被删除
+     *      4.compress为true时，旧文件由后台线程用gzip压缩为 .gz，压缩完成后删除原文件
+     *      5.设置了文件头(setHeader)时，每个切分出的新文件先写入文件头，例如二进制日志的调用点定义
      */
-    // class DailyFileSinker : public Sinker_Base
-    // {
-    // };
+    class RollFileSinker : public FileSinker
+    {
+    public:
+        /// @param file 日志文件
+        /// @param maxBytes 单个文件的大小上限，0表示不按大小切分
+        /// @param intervalSec 按时间切分的间隔，按本地时间对齐(如3600为整点，86400为每天零点)，0表示不按时间切分
+        /// @param keep 保留的旧文件个数
+        /// @param compress 是否压缩旧文件
+        /// @param sync 落盘策略
+        /// @param syncIntervalMs PERIODIC 的同步间隔
+        RollFileSinker(const std::string &file, size_t maxBytes, time_t intervalSec = 0, size_t keep = 7, bool compress = false,
+                       SyncPolicy sync = SyncPolicy::NONE, size_t syncIntervalMs = 1000)
+            : FileSinker(file, sync, syncIntervalMs), _maxBytes(maxBytes), _intervalSec(intervalSec), _keep(keep),
+              _compress(compress), _stop(false)
+        {
+            loadHistory();
+            resetSize();
+            if (_compress)
+                _worker = std::thread(&RollFileSinker::workerRunning, this);
+        }
+        ~RollFileSinker()
+        {
+            if (_worker.joinable())
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _stop = true;
+                }
+                _cond.notify_all();
+                _worker.join();
+            }
+        }
+
+        virtual bool run(const char *message, size_t size)
+        {
+            struct iovec iov = {(void *)message, size};
+            return runv(&iov, 1);
+        }
+        virtual bool runv(const struct iovec *iov, int cnt)
+        {
+            time_t now = TimeUtil::getTime();
+            if (_intervalSec > 0 && period(now) != _period)
+            {
+                // 空文件不用切分，直接归入新的时间间隔，否则下一条日志会把它当成旧间隔的文件切走
+                if (_size > 0)
+                    roll(now);
+                else
+                    _period = period(now);
+            }
+            // 放不进当前文件的日志从它开始写入新文件，前面的部分一次writev写入当前文件
+            bool ok = true;
+            int begin = 0;
+            size_t bytes = 0; // [begin, i) 的总长度
+            for (int i = 0; i < cnt; ++i)
+            {
+                if (_maxBytes > 0 && _size + bytes + iov[i].iov_len > _maxBytes && _size + bytes > 0)
+                {
+                    if (i > begin)
+                        ok = FileSinker::runv(iov + begin, i - begin) && ok;
+                    _size += bytes;
+                    roll(now);
+                    begin = i;
+                    bytes = 0;
+                }
+                bytes += iov[i].iov_len;
+            }
+            if (cnt > begin)
+                ok = FileSinker::runv(iov + begin, cnt - begin) && ok;
+            _size += bytes;
+            return ok;
+        }
+        virtual void setHeader(header_func_t header)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _header = header;
+        }
+
+    private:
+        // now所在的时间间隔编号，按本地时间对齐
+        time_t period(time_t now)
+        {
+            if (_intervalSec <= 0)
+                return 0;
+            tm lt;
+            localtime_r(&now, &lt);
+            return (now + lt.tm_gmtoff) / _intervalSec;
+        }
+        // 按当前文件重新计算大小和时间间隔
+        void resetSize()
+        {
+            struct stat st;
+            _size = fstat(_fd, &st) == 0 ? st.st_size : 0;
+            _period = period(TimeUtil::getTime());
+        }
+        // 切分：重命名当前文件并重新打开
+        void roll(time_t now)
+        {
+            tm lt;
+            localtime_r(&now, &lt);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), ".%Y%m%d-%H%M%S", &lt);
+            // 同一秒内多次切分时加上递增的序号，保证文件名按时间排序：file.时间 < file.时间-001 < file.时间-002
+            _rollSeq = (_lastStamp == stamp) ? _rollSeq + 1 : 0;
+            _lastStamp = stamp;
+            std::string name;
+            while (true)
+            {
+                char seq[16] = "";
+                if (_rollSeq > 0)
+                    snprintf(seq, sizeof(seq), "-%03d", _rollSeq);
+                name = _file + stamp + seq;
+                if (!FileUtil::exists(name) && !FileUtil::exists(name + ".gz"))
+                    break;
+                ++_rollSeq;
+            }
+            if (rename(_file.c_str(), name.c_str()) != 0)
+                std::cout << "日志文件重命名失败: " << _file << "\n";
+            reopen();
+            resetSize();
+            writeHeader();
+            if (_compress)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _pending.push_back(name);
+                }
+                _cond.notify_one();
+            }
+            else
+            {
+                _history.push_back(name);
+                prune();
+            }
+        }
+        // 在新文件开头写入文件头
+        void writeHeader()
+        {
+            LogBuffer &buf = LogBuffer::threadLocal<3>();
+            buf.clear();
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_header)
+                    _header(buf);
+            }
+            if (buf.size() == 0)
+                return;
+            struct iovec iov = {(void *)buf.data(), buf.size()};
+            writeAll(&iov, 1);
+            _size += buf.size();
+        }
+        // 删除超出保留个数的旧文件
+        void prune()
+        {
+            while (_history.size() > _keep)
+            {
+                unlink(_history.front().c_str());
+                unlink((_history.front() + ".gz").c_str());
+                _history.pop_front();
+            }
+        }
+        // 启动时找出已有的旧文件，按文件名(即时间)排序
+        void loadHistory()
+        {
+            std::string dir = FileUtil::getPath(_file);
+            std::string base = _file.substr(_file.find_last_of("/\\") == std::string::npos ? 0 : _file.find_last_of("/\\") + 1);
+            DIR *dp = opendir(dir.c_str());
+            if (dp == nullptr)
+                return;
+            std::vector<std::string> names;
+            while (struct dirent *ent = readdir(dp))
+            {
+                std::string name = ent->d_name;
+                // 只认 file.YYYYmmdd-HHMMSS 形式的文件，不误删其他同名前缀的文件
+                if (name.size() <= base.size() + 1 || name.compare(0, base.size() + 1, base + ".") != 0 ||
+                    !isdigit((unsigned char)name[base.size() + 1]))
+                    continue;
+                if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0)
+                    name.resize(name.size() - 3);
+                else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+                    continue;
+                names.push_back(dir == "." ? name : (dir.back() == '/' ? dir : dir + "/") + name);
+            }
+            closedir(dp);
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+            _history.assign(names.begin(), names.end());
+            // 上次退出时没有压缩完的文件，重新压缩
+            if (_compress)
+                for (const std::string &name : names)
+                    if (FileUtil::exists(name))
+                        _pending.push_back(name);
+        }
+        // 后台压缩线程
+        void workerRunning()
+        {
+            while (true)
+            {
+                std::string name;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _cond.wait(lock, [&] { return _stop || !_pending.empty(); });
+                    if (_pending.empty())
+                        return;
+                    name = _pending.front();
+                    _pending.pop_front();
+                }
+                gzipFile(name);
+                if (std::find(_history.begin(), _history.end(), name) == _history.end())
+                    _history.push_back(name);
+                prune();
+            }
+        }
+        // 压缩为 name.gz，先写临时文件再重命名，压缩成功后删除原文件
+        static bool gzipFile(const std::string &name)
+        {
+            FILE *in = fopen(name.c_str(), "rb");
+            if (in == nullptr)
+                return false;
+            std::string tmp = name + ".gz.tmp";
+            gzFile out = gzopen(tmp.c_str(), "wb6");
+            if (out == nullptr)
+            {
+                fclose(in);
+                return false;
+            }
+            char buf[64 * 1024];
+            size_t n;
+            bool ok = true;
+            while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+                ok = gzwrite(out, buf, (unsigned)n) == (int)n;
+            fclose(in);
+            ok = (gzclose(out) == Z_OK) && ok;
+            if (!ok || rename(tmp.c_str(), (name + ".gz").c_str()) != 0)
+            {
+                unlink(tmp.c_str());
+                return false;
+            }
+            unlink(name.c_str());
+            return true;
+        }
+
+    private:
+        size_t _maxBytes;
+        time_t _intervalSec;
+        size_t _keep;
+        bool _compress;
+        size_t _size;                      // 当前文件大小
+        time_t _period;                    // 当前文件所在的时间间隔
+        std::string _lastStamp;            // 上一次切分的时间
+        int _rollSeq = 0;                  // 同一秒内的切分序号
+        std::deque<std::string> _history;  // 旧文件，从旧到新(不含.gz后缀)。开启压缩时只由后台线程访问
+        header_func_t _header;             // 新文件的文件头
+        std::mutex _mtx;                   // 保护 _pending、_stop 和 _header
+        std::condition_variable _cond;
+        std::deque<std::string> _pending;  // 等待压缩的旧文件
+        bool _stop;
+        std::thread _worker;               // 后台压缩线程
+    };
 
     /**
      * @brief 创建Sinker对象，并返回该对象的智能指针
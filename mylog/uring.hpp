@@ -0,0 +1,152 @@
+#ifndef _URING_HPP_
+#define _URING_HPP_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace mylog
+{
+    /**
+     * @brief io_uring 的最小封装，直接使用系统调用，不依赖 liburing
+     *
+     *      只由一个线程使用：getSqe() 填写提交项，submit() 提交并可以等待完成，peekCqe() 取出完成项。
+     *      内核不支持或被禁用时 init() 返回false，由调用者退回普通的系统调用
+     */
+    class IoUring
+    {
+    private:
+        int _fd;
+        // 提交队列
+        void *_sqPtr;
+        size_t _sqSize;
+        unsigned *_sqHead;
+        unsigned *_sqTail;
+        unsigned *_sqMask;
+        unsigned *_sqArray;
+        struct io_uring_sqe *_sqes;
+        size_t _sqesSize;
+        unsigned _sqLocalTail; // 已填写、还没有提交给内核的位置
+        // 完成队列
+        void *_cqPtr;
+        size_t _cqSize;
+        unsigned *_cqHead;
+        unsigned *_cqTail;
+        unsigned *_cqMask;
+        struct io_uring_cqe *_cqes;
+        unsigned _entries;
+
+    public:
+        IoUring()
+            : _fd(-1), _sqPtr(MAP_FAILED), _sqSize(0), _sqes((struct io_uring_sqe *)MAP_FAILED), _sqesSize(0),
+              _sqLocalTail(0), _cqPtr(MAP_FAILED), _cqSize(0), _entries(0)
+        {
+        }
+        ~IoUring()
+        {
+            if (_sqes != MAP_FAILED)
+                munmap(_sqes, _sqesSize);
+            if (_cqPtr != MAP_FAILED && _cqPtr != _sqPtr)
+                munmap(_cqPtr, _cqSize);
+            if (_sqPtr != MAP_FAILED)
+                munmap(_sqPtr, _sqSize);
+            if (_fd >= 0)
+                close(_fd);
+        }
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        /// @brief 创建队列并映射共享内存
+        /// @param entries 提交队列长度
+        /// @return 是否成功
+        bool init(unsigned entries)
+        {
+            struct io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            _fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+            if (_fd < 0)
+                return false;
+            _entries = p.sq_entries;
+            _sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            _cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+            bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single && _cqSize > _sqSize)
+                _sqSize = _cqSize;
+            _sqPtr = mmap(nullptr, _sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+            if (_sqPtr == MAP_FAILED)
+                return false;
+            _cqPtr = single ? _sqPtr : mmap(nullptr, _cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+            if (_cqPtr == MAP_FAILED)
+                return false;
+            _sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+            _sqes = (struct io_uring_sqe *)mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+            if (_sqes == MAP_FAILED)
+                return false;
+            char *sq = (char *)_sqPtr;
+            _sqHead = (unsigned *)(sq + p.sq_off.head);
+            _sqTail = (unsigned *)(sq + p.sq_off.tail);
+            _sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+            _sqArray = (unsigned *)(sq + p.sq_off.array);
+            _sqLocalTail = *_sqTail;
+            char *cq = (char *)_cqPtr;
+            _cqHead = (unsigned *)(cq + p.cq_off.head);
+            _cqTail = (unsigned *)(cq + p.cq_off.tail);
+            _cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+            _cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+            return true;
+        }
+        /// @brief 注册固定缓冲区，之后可以用 IORING_OP_WRITE_FIXED 写这些缓冲区，内核不必每次映射用户内存
+        bool registerBuffers(const struct iovec *iov, unsigned cnt)
+        {
+            return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, iov, cnt) == 0;
+        }
+        /// @brief 取一个空闲的提交项，已清零。队列满时返回nullptr
+        struct io_uring_sqe *getSqe()
+        {
+            unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+            if (_sqLocalTail - head >= _entries)
+                return nullptr;
+            unsigned idx = _sqLocalTail & *_sqMask;
+            struct io_uring_sqe *sqe = &_sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            _sqArray[idx] = idx;
+            ++_sqLocalTail;
+            return sqe;
+        }
+        /// @brief 提交已填写的提交项
+        /// @param waitNr 至少等待这么多个完成项，0表示不等待
+        /// @return 提交的个数，失败返回-1
+        int submit(unsigned waitNr = 0)
+        {
+            unsigned toSubmit = _sqLocalTail - *_sqTail;
+            __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+            unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+            while (true)
+            {
+                int ret = (int)syscall(__NR_io_uring_enter, _fd, toSubmit, waitNr, flags, nullptr, 0);
+                if (ret >= 0 || errno != EINTR)
+                    return ret;
+            }
+        }
+        /// @brief 取出一个完成项
+        /// @return 没有完成项时返回false
+        bool peekCqe(uint64_t &userData, int &res)
+        {
+            unsigned head = *_cqHead;
+            if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+                return false;
+            const struct io_uring_cqe &cqe = _cqes[head & *_cqMask];
+            userData = cqe.user_data;
+            res = cqe.res;
+            __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+    };
+}
+
+#endif
@@ -5,6 +5,9 @@
 #include <iostream>
 #include <fstream>
 #include <sys/stat.h>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
 
 namespace mylog
 {
@@ -16,6 +19,37 @@ namespace mylog
         {
             return (time_t)time(nullptr);
         }
+        // 获取当前系统时间，精确到微秒。
+        // 每个线程记录一次系统时间与单调时钟的对应关系，之后用单调时钟推算，每隔一段时间重新校准，跟上系统时间的调整。
+        // 校准造成的小幅回退会被截平，同一线程内的时间不会因此回退；只有系统时间被调回超过1秒时才跟着回退
+        static int64_t getTimeUs()
+        {
+            using namespace std::chrono;
+            struct Calibration
+            {
+                int64_t wallUs = 0;
+                int64_t lastUs = 0; // 上一次返回的时间
+                steady_clock::time_point base;
+            };
+            static thread_local Calibration calib;
+            steady_clock::time_point now = steady_clock::now();
+            int64_t elapsed = duration_cast<microseconds>(now - calib.base).count();
+            if (calib.wallUs == 0 || elapsed >= CALIBRATE_INTERVAL_US)
+            {
+                calib.wallUs = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+                calib.base = now;
+                elapsed = 0;
+            }
+            int64_t us = calib.wallUs + elapsed;
+            if (us < calib.lastUs && calib.lastUs - us < MAX_CLAMP_US)
+                us = calib.lastUs;
+            calib.lastUs = us;
+            return us;
+        }
+
+    private:
+        static const int64_t CALIBRATE_INTERVAL_US = 10 * 1000 * 1000; // 重新校准的间隔
+        static const int64_t MAX_CLAMP_US = 1000 * 1000;               // 小于该值的回退被截平
     };
     class FileUtil
     {
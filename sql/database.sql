@@ -9,3 +9,10 @@ create table if not exists user(
     pk_cnt int,
     win_cnt int
 );
+-- 已经应用到user表的对局结果，用于对局结果重放时去重。
+-- 序号只在一个发件箱文件的纪元(epoch)内唯一，纪元是文件创建/截断时生成的随机数
+create table if not exists game_result_applied(
+    epoch bigint unsigned not null,
+    seq bigint unsigned not null,
+    primary key(epoch, seq)
+);
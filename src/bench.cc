@@ -0,0 +1,393 @@
+/**
+ * 热点路径的微基准测试，单独编译运行：make bench && ./bench
+ * 统计每条消息的耗时(ns)与堆内存分配次数；编解码结果不对时返回非0。
+ */
+#include "util.hpp"
+#include "codec.hpp"
+#include "rateLimiter.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <new>
+#include <sstream>
+
+static std::atomic<uint64_t> g_allocs(0);
+
+void *operator new(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace bench
+{
+    const int ITERATIONS = 200000;
+
+    /*运行func ITERATIONS次，输出每次的平均耗时和内存分配次数*/
+    template <typename Func>
+    void run(const char *name, Func func)
+    {
+        for (int i = 0; i < 1000; ++i) // 预热，让复用的缓冲区达到稳定大小
+            func();
+        uint64_t allocs = g_allocs.load();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i)
+            func();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        printf("%-36s %10.1f ns/msg %8.2f allocs/msg\n", name, (double)ns / ITERATIONS,
+               (double)(g_allocs.load() - allocs) / ITERATIONS);
+    }
+
+    /*改造前的util::json实现：每次都新建builder、writer/reader和stringstream*/
+    bool old_serialize(const Json::Value &root, std::string &str)
+    {
+        Json::StreamWriterBuilder swb;
+        std::unique_ptr<Json::StreamWriter> sw(swb.newStreamWriter());
+        std::stringstream ss;
+        if (sw->write(root, &ss) != 0)
+            return false;
+        str = ss.str();
+        return true;
+    }
+    bool old_unserialize(const std::string &str, Json::Value &root)
+    {
+        Json::CharReaderBuilder crb;
+        std::unique_ptr<Json::CharReader> cr(crb.newCharReader());
+        std::string err;
+        return cr->parse(str.c_str(), str.c_str() + str.size(), &root, &err);
+    }
+
+    void json()
+    {
+        Json::Value rsp;
+        rsp["optype"] = "put_chess";
+        rsp["result"] = true;
+        rsp["reason"] = "继续下棋";
+        rsp["room_id"] = 12;
+        rsp["uid"] = 10086;
+        rsp["row"] = 7;
+        rsp["col"] = 8;
+        rsp["winner"] = 0;
+        std::string body;
+        gomoku::util::json::serialize(rsp, body);
+        printf("message: %s\n", body.c_str());
+
+        std::string out;
+        run("json serialize (before)", [&]() { old_serialize(rsp, out); });
+        run("json serialize (thread_local)", [&]() { gomoku::util::json::serialize(rsp, out); });
+        Json::Value req;
+        run("json unserialize (before)", [&]() { old_unserialize(body, req); });
+        run("json unserialize (thread_local)", [&]() { gomoku::util::json::unserialize(body, req); });
+    }
+
+    /*一次落子的完整编解码：解析put_chess请求 + 生成响应*/
+    void move()
+    {
+        const std::string req_str = "{\"optype\":\"put_chess\",\"room_id\":12,\"uid\":10086,\"row\":7,\"col\":8}";
+        std::string out;
+        run("put_chess via Json::Value", [&]() {
+            Json::Value req;
+            gomoku::util::json::unserialize(req_str, req);
+            Json::Value rsp = req;
+            rsp["result"] = true;
+            rsp["reason"] = "继续下棋";
+            rsp["winner"] = 0;
+            gomoku::util::json::serialize(rsp, out);
+        });
+        gomoku::JsonBuf buf;
+        run("put_chess via codec", [&]() {
+            gomoku::RoomMsg req;
+            gomoku::codec::DecodeRoomMsg(req_str.c_str(), req_str.size(), gomoku::Optype::PUT_CHESS, req);
+            gomoku::codec::EncodePutChess(buf, req, true, "继续下棋", 0);
+        });
+        printf("message: %.*s\n", (int)buf.Size(), buf.Data());
+    }
+
+    /*chat的编解码；超出JsonBuf栈上空间的聊天内容也必须完整送达，否则返回false*/
+    bool chat()
+    {
+        std::string text(6000, 'x');
+        text += "末尾\"引号\"";
+        Json::Value req;
+        req["optype"] = "chat";
+        req["room_id"] = 12;
+        req["uid"] = 10086;
+        req["message"] = text;
+        std::string req_str;
+        gomoku::util::json::serialize(req, req_str);
+        gomoku::RoomMsg msg;
+        if (!gomoku::codec::DecodeRoomMsg(req_str.c_str(), req_str.size(), gomoku::Optype::CHAT, msg))
+        {
+            // 带转义字符的消息走jsoncpp，和房间的退回路径一样
+            msg.op = gomoku::Optype::CHAT;
+            msg.roomId = 12;
+            msg.uid = 10086;
+            msg.message.data = text.c_str();
+            msg.message.len = text.size();
+        }
+        gomoku::JsonBuf buf;
+        gomoku::codec::EncodeChat(buf, msg);
+        Json::Value rsp;
+        if (!gomoku::util::json::unserialize(std::string(buf.Data(), buf.Size()), rsp) ||
+            rsp["message"].asString() != text || rsp["result"].asBool() != true)
+        {
+            printf("oversized chat: FAILED (%zu bytes)\n", buf.Size());
+            return false;
+        }
+        printf("oversized chat: ok (%zu bytes)\n", buf.Size());
+
+        const std::string short_str = "{\"optype\":\"chat\",\"room_id\":12,\"uid\":10086,\"message\":\"gg\"}";
+        run("chat via codec", [&]() {
+            gomoku::RoomMsg m;
+            gomoku::codec::DecodeRoomMsg(short_str.c_str(), short_str.size(), gomoku::Optype::CHAT, m);
+            gomoku::codec::EncodeChat(buf, m);
+        });
+        return true;
+    }
+
+    /*限流表已满时，每个新key(例如伪造的ip)的开销不随表的大小增长，表的大小不超过maxKeys*/
+    bool rate_limit()
+    {
+        gomoku::RateLimitOptions::Instance().maxKeys = 100000;
+        gomoku::RateLimiter limiter;
+        gomoku::RateBudget budget{1, 5};
+        uint64_t key = 0;
+        run("rate limit (new key, table full)", [&]() {
+            limiter.Allow(++key, gomoku::RATE_HTTP_LOGIN, budget);
+        });
+        if (limiter.Size() > gomoku::RateLimitOptions::Instance().maxKeys)
+        {
+            printf("rate limit table: FAILED (%zu keys)\n", limiter.Size());
+            return false;
+        }
+        printf("rate limit table: ok (%zu keys)\n", limiter.Size());
+        return true;
+    }
+
+    /*
+        按时间切分：文件在一个时间间隔内没有写入，跨过间隔后写入的日志应该留在当前文件，
+        不能在下一条日志时被当成旧间隔的文件切走
+    */
+    bool roll_idle()
+    {
+        const std::string dir = "/tmp/gomoku_bench_roll/";
+        mylog::FileUtil::createDir(dir);
+        system(("rm -f " + dir + "*").c_str());
+        {
+            mylog::RollFileSinker sinker(dir + "app.log", 0, 1, 3);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1500)); // 空闲，跨过一个间隔
+            sinker.run("a\n", 2);
+            sinker.run("b\n", 2);
+        }
+        std::string body;
+        gomoku::util::file::read(dir + "app.log", body);
+        int files = 0;
+        DIR *d = opendir(dir.c_str());
+        for (struct dirent *e = d ? readdir(d) : nullptr; e; e = readdir(d))
+            files += e->d_name[0] != '.';
+        if (d)
+            closedir(d);
+        if (files != 1 || body != "a\nb\n")
+        {
+            printf("roll after idle interval: FAILED (%d files)\n", files);
+            return false;
+        }
+        printf("roll after idle interval: ok\n");
+        return true;
+    }
+
+    /*改造前的日志格式化：每一项一个虚函数调用，写入stringstream，行号经过std::to_string*/
+    namespace old_log
+    {
+        struct LogInfo
+        {
+            mylog::Level::Value level;
+            time_t timestamp;
+            size_t line;
+            std::thread::id tid;
+            std::string file;
+            std::string loggerName;
+            std::string message;
+        };
+        struct Item
+        {
+            virtual void getItem(std::ostream &os, const LogInfo &info) = 0;
+            virtual ~Item() {}
+        };
+        struct TimeItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info)
+            {
+                std::string str = "";
+                time_t timestamp = info.timestamp;
+                tm *timeinfo = localtime(&timestamp);
+                if (timeinfo)
+                {
+                    str += std::to_string(timeinfo->tm_year + 1900);
+                    str += "-";
+                    str += std::to_string(timeinfo->tm_mon + 1);
+                    str += "-";
+                    str += std::to_string(timeinfo->tm_mday);
+                    str += " ";
+                    str += std::to_string(timeinfo->tm_hour);
+                    str += ":";
+                    str += std::to_string(timeinfo->tm_min);
+                    str += ":";
+                    str += std::to_string(timeinfo->tm_sec);
+                }
+                os << str;
+            }
+        };
+        struct LevelItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info) { os << mylog::Level::toString(info.level); }
+        };
+        struct LoggerNameItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info) { os << info.loggerName; }
+        };
+        struct ThreadIDItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info) { os << info.tid; }
+        };
+        struct FileItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info) { os << info.file; }
+        };
+        struct LineItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info) { os << std::to_string(info.line); }
+        };
+        struct MessageItem : Item
+        {
+            void getItem(std::ostream &os, const LogInfo &info) { os << info.message; }
+        };
+        struct OtherItem : Item
+        {
+            std::string _str;
+            OtherItem(const std::string &str) : _str(str) {}
+            void getItem(std::ostream &os, const LogInfo &info) { os << _str; }
+        };
+        /*按默认格式 [%t][%c][%n][%i][%f%S:%S%l]%T%m%N 组装的子项*/
+        std::vector<std::shared_ptr<Item>> defaultItems()
+        {
+            std::vector<std::shared_ptr<Item>> items;
+            items.emplace_back(new OtherItem("["));
+            items.emplace_back(new TimeItem());
+            items.emplace_back(new OtherItem("]["));
+            items.emplace_back(new LevelItem());
+            items.emplace_back(new OtherItem("]["));
+            items.emplace_back(new LoggerNameItem());
+            items.emplace_back(new OtherItem("]["));
+            items.emplace_back(new ThreadIDItem());
+            items.emplace_back(new OtherItem("]["));
+            items.emplace_back(new FileItem());
+            items.emplace_back(new OtherItem(" "));
+            items.emplace_back(new OtherItem(":"));
+            items.emplace_back(new OtherItem(" "));
+            items.emplace_back(new LineItem());
+            items.emplace_back(new OtherItem("]"));
+            items.emplace_back(new OtherItem("\t"));
+            items.emplace_back(new MessageItem());
+            items.emplace_back(new OtherItem("\n"));
+            return items;
+        }
+    }
+
+    /*一行日志的格式化(默认格式)，不含日志主体的printf*/
+    void log_format()
+    {
+        const char *msg = "用户登录成功, uid: 10086";
+        old_log::LogInfo old_info{mylog::Level::Value::INFO, time(nullptr), 233, std::this_thread::get_id(),
+                                  "server.hpp", "defaultConsoleSyncLogger", msg};
+        std::vector<std::shared_ptr<old_log::Item>> items = old_log::defaultItems();
+        std::string line;
+        run("log format (virtual items)", [&]() {
+            std::stringstream ss;
+            for (auto &it : items)
+                it->getItem(ss, old_info);
+            line = ss.str();
+        });
+        mylog::Formatter fmt;
+        mylog::LogBuffer buf;
+        mylog::LogInfo info(mylog::Level::Value::INFO, "defaultConsoleSyncLogger", "server.hpp", 233, msg, strlen(msg));
+        run("log format (opcodes)", [&]() {
+            buf.clear();
+            fmt.run(buf, info);
+        });
+        printf("message: %.*s", (int)buf.size(), buf.data());
+    }
+
+    /*
+        生产者一侧写一条日志的开销：文本模式为printf+格式化，二进制模式只写调用点id和参数，
+        两者都写入异步环形缓冲区。缓冲区在同一线程中定期清空，不计入消费者线程和落地的开销
+    */
+    mylog::AsyncLoggerRing g_ring;
+    void text_record(mylog::Formatter &fmt, const char *format, ...)
+    {
+        mylog::LogBuffer &msg = mylog::LogBuffer::threadLocal<0>();
+        msg.clear();
+        va_list al;
+        va_start(al, format);
+        msg.appendv(format, al);
+        va_end(al);
+        mylog::LogInfo info(mylog::Level::Value::INFO, "game", __FILE__, __LINE__, msg.data(), msg.size());
+        mylog::LogBuffer &out = mylog::LogBuffer::threadLocal<1>();
+        out.clear();
+        fmt.run(out, info);
+        g_ring.tryPush(out.data(), out.size());
+    }
+    template <typename... Args>
+    void binary_record(uint32_t id, const Args &...args)
+    {
+        mylog::LogBuffer &buf = mylog::LogBuffer::threadLocal<2>();
+        mylog::binlog::encodeRecord(buf, id, mylog::TimeUtil::getTimeUs(), mylog::LogInfo::threadId(), args...);
+        g_ring.tryPush(buf.data(), buf.size());
+    }
+    void log_record()
+    {
+        auto drain = []() { g_ring.consume([](const char *, size_t) { return true; }); };
+        mylog::Formatter fmt;
+        uint64_t uid = 10086;
+        int i = 0;
+        run("log record (text)", [&]() {
+            text_record(fmt, "落子 uid: %lu, row: %d, col: %d, room: %s", uid, 7, 8, "r12");
+            if (++i % 1000 == 0)
+                drain();
+        });
+        uint32_t id = mylog::binlog::Registry::instance().add(mylog::Level::Value::INFO, __FILE__, __LINE__,
+                                                              "落子 uid: %lu, row: %d, col: %d, room: %s");
+        run("log record (binary)", [&]() {
+            binary_record(id, uid, 7, 8, "r12");
+            if (++i % 1000 == 0)
+                drain();
+        });
+    }
+}
+
+int main()
+{
+    bench::json();
+    bench::move();
+    if (!bench::chat())
+        return 1;
+    if (!bench::rate_limit())
+        return 1;
+    if (!bench::roll_idle())
+        return 1;
+    bench::log_format();
+    bench::log_record();
+    return 0;
+}
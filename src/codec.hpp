@@ -0,0 +1,399 @@
+#ifndef _CODEC_HPP_
+#define _CODEC_HPP_
+/**
+ * 热点消息的专用编解码，不经过Json::Value。
+ * - 解码：直接从消息负载中读出字段到RoomMsg，字符串字段只记录在负载中的位置，不拷贝
+ * - 编码：把响应写进JsonBuf，常见大小的消息只用栈上空间，不分配堆内存
+ * 只处理扁平、无转义字符的对象，遇到其他情况返回false，由调用者退回jsoncpp处理。
+ */
+#include "router.hpp"
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace gomoku
+{
+    /*指向消息负载中某段字符串，不拥有内存*/
+    struct StrView
+    {
+        const char *data = nullptr;
+        size_t len = 0;
+    };
+
+    /*房间内的请求：put_chess / chat*/
+    struct RoomMsg
+    {
+        Optype op = Optype::UNKNOWN;
+        uint64_t roomId = 0;
+        uint64_t uid = 0;
+        int row = -1;
+        int col = -1;
+        StrView message; // chat的聊天内容
+    };
+
+    /*Json输出缓冲区：先写栈上的固定空间，放不下时(如很长的聊天内容)整体搬到堆上继续写*/
+    class JsonBuf
+    {
+    public:
+        static const size_t CAPACITY = 4096; // 栈上空间的大小
+
+    private:
+        char _buf[CAPACITY];
+        size_t _len = 0;
+        std::string _heap;    // 超出CAPACITY后的内容
+        bool _onHeap = false;
+        bool _first = true;   // 当前对象是否还没有字段，决定是否需要写逗号
+
+    public:
+        const char *Data() const { return _onHeap ? _heap.data() : _buf; }
+        size_t Size() const { return _onHeap ? _heap.size() : _len; }
+
+        JsonBuf &Begin()
+        {
+            _len = 0;
+            _heap.clear();
+            _onHeap = false;
+            _first = true;
+            __Raw("{", 1);
+            return *this;
+        }
+        JsonBuf &End()
+        {
+            __Raw("}", 1);
+            return *this;
+        }
+        JsonBuf &Str(const char *key, const char *val) { return Str(key, val, strlen(val)); }
+        JsonBuf &Str(const char *key, const char *val, size_t len)
+        {
+            __Key(key);
+            __Raw("\"", 1);
+            __Escape(val, len);
+            __Raw("\"", 1);
+            return *this;
+        }
+        JsonBuf &Bool(const char *key, bool val)
+        {
+            __Key(key);
+            return val ? __Raw("true", 4) : __Raw("false", 5);
+        }
+        JsonBuf &Uint(const char *key, uint64_t val)
+        {
+            __Key(key);
+            __Digits(val);
+            return *this;
+        }
+        JsonBuf &Int(const char *key, int64_t val)
+        {
+            __Key(key);
+            if (val < 0)
+            {
+                __Raw("-", 1);
+                __Digits((uint64_t)(-(val + 1)) + 1);
+            }
+            else
+                __Digits((uint64_t)val);
+            return *this;
+        }
+
+    private:
+        JsonBuf &__Raw(const char *s, size_t n)
+        {
+            if (!_onHeap && _len + n > CAPACITY)
+            {
+                _heap.reserve(CAPACITY * 2 + n);
+                _heap.assign(_buf, _len);
+                _onHeap = true;
+            }
+            if (_onHeap)
+            {
+                _heap.append(s, n);
+                return *this;
+            }
+            memcpy(_buf + _len, s, n);
+            _len += n;
+            return *this;
+        }
+        void __Key(const char *key)
+        {
+            if (!_first)
+                __Raw(",", 1);
+            _first = false;
+            __Raw("\"", 1);
+            __Raw(key, strlen(key));
+            __Raw("\":", 2);
+        }
+        void __Digits(uint64_t val)
+        {
+            char tmp[20];
+            int n = sizeof(tmp);
+            do
+            {
+                tmp[--n] = (char)('0' + val % 10);
+                val /= 10;
+            } while (val != 0);
+            __Raw(tmp + n, sizeof(tmp) - n);
+        }
+        void __Escape(const char *s, size_t len)
+        {
+            static const char hex[] = "0123456789abcdef";
+            for (size_t i = 0; i < len; ++i)
+            {
+                unsigned char c = (unsigned char)s[i];
+                if (c == '"' || c == '\\')
+                {
+                    char esc[2] = {'\\', (char)c};
+                    __Raw(esc, 2);
+                }
+                else if (c < 0x20)
+                {
+                    char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                    __Raw(esc, 6);
+                }
+                else
+                    __Raw(s + i, 1);
+            }
+        }
+    };
+
+    namespace codec
+    {
+        /*扁平Json对象的游标式解析器，只支持 字符串(无转义)/整数/true/false/null 值*/
+        class FlatParser
+        {
+        private:
+            const char *_p;
+            const char *_end;
+            bool _first = true; // 是否还没有读过key
+
+        public:
+            FlatParser(const char *data, size_t len) : _p(data), _end(data + len) {}
+
+            bool Begin()
+            {
+                __Ws();
+                return __Eat('{');
+            }
+            /*读取下一个key，对象结束时done置为true，格式不支持时返回false*/
+            bool NextKey(StrView &key, bool &done)
+            {
+                __Ws();
+                done = false;
+                if (__Eat('}'))
+                {
+                    done = true;
+                    __Ws();
+                    return _p == _end;
+                }
+                if (!_first && !__Eat(','))
+                    return false;
+                _first = false;
+                __Ws();
+                if (!__String(key))
+                    return false;
+                __Ws();
+                if (!__Eat(':'))
+                    return false;
+                __Ws();
+                return true;
+            }
+            bool String(StrView &val) { return __String(val); }
+            bool Int(int64_t &val)
+            {
+                const char *start = _p;
+                bool neg = (_p < _end && *_p == '-');
+                if (neg)
+                    ++_p;
+                uint64_t v = 0;
+                int digits = 0;
+                while (_p < _end && *_p >= '0' && *_p <= '9' && digits < 18)
+                {
+                    v = v * 10 + (*_p++ - '0');
+                    ++digits;
+                }
+                if (digits == 0 || (_p < _end && (*_p == '.' || *_p == 'e' || *_p == 'E' || (*_p >= '0' && *_p <= '9'))))
+                {
+                    _p = start;
+                    return false; // 小数、超长整数交给jsoncpp
+                }
+                val = neg ? -(int64_t)v : (int64_t)v;
+                return true;
+            }
+            /*跳过一个不关心的值，遇到对象/数组返回false*/
+            bool Skip()
+            {
+                StrView s;
+                int64_t i;
+                if (_p < _end && *_p == '"')
+                    return __String(s);
+                if (__Literal("true") || __Literal("false") || __Literal("null"))
+                    return true;
+                return Int(i);
+            }
+
+        private:
+            void __Ws()
+            {
+                while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+                    ++_p;
+            }
+            bool __Eat(char c)
+            {
+                if (_p < _end && *_p == c)
+                {
+                    ++_p;
+                    return true;
+                }
+                return false;
+            }
+            bool __Literal(const char *lit)
+            {
+                size_t n = strlen(lit);
+                if ((size_t)(_end - _p) >= n && memcmp(_p, lit, n) == 0)
+                {
+                    _p += n;
+                    return true;
+                }
+                return false;
+            }
+            bool __String(StrView &val)
+            {
+                if (!__Eat('"'))
+                    return false;
+                const char *begin = _p;
+                while (_p < _end && *_p != '"')
+                {
+                    if (*_p == '\\' || (unsigned char)*_p < 0x20)
+                        return false; // 带转义的字符串交给jsoncpp
+                    ++_p;
+                }
+                if (_p == _end)
+                    return false;
+                val.data = begin;
+                val.len = _p - begin;
+                ++_p;
+                return true;
+            }
+        };
+
+        /*
+            解码房间内的put_chess/chat请求，op是分发前已经解析出的optype。
+            格式不在支持范围内、或缺少必要字段时返回false，调用者应退回jsoncpp
+        */
+        inline bool DecodeRoomMsg(const char *data, size_t len, Optype op, RoomMsg &msg)
+        {
+            if (op != Optype::PUT_CHESS && op != Optype::CHAT)
+                return false;
+            FlatParser fp(data, len);
+            if (!fp.Begin())
+                return false;
+            msg = RoomMsg();
+            msg.op = op;
+            bool has_room = false, has_uid = false, has_row = false, has_col = false, has_msg = false;
+            while (true)
+            {
+                StrView key;
+                bool done;
+                if (!fp.NextKey(key, done))
+                    return false;
+                if (done)
+                    break;
+                int64_t v;
+                if (router::Equal(key.data, key.len, "room_id"))
+                {
+                    if (!fp.Int(v) || v < 0)
+                        return false;
+                    msg.roomId = (uint64_t)v;
+                    has_room = true;
+                }
+                else if (router::Equal(key.data, key.len, "uid"))
+                {
+                    if (!fp.Int(v) || v < 0)
+                        return false;
+                    msg.uid = (uint64_t)v;
+                    has_uid = true;
+                }
+                else if (router::Equal(key.data, key.len, "row"))
+                {
+                    if (!fp.Int(v) || v < INT_MIN || v > INT_MAX)
+                        return false;
+                    msg.row = (int)v;
+                    has_row = true;
+                }
+                else if (router::Equal(key.data, key.len, "col"))
+                {
+                    if (!fp.Int(v) || v < INT_MIN || v > INT_MAX)
+                        return false;
+                    msg.col = (int)v;
+                    has_col = true;
+                }
+                else if (router::Equal(key.data, key.len, "message"))
+                {
+                    if (!fp.String(msg.message))
+                        return false;
+                    has_msg = true;
+                }
+                else if (!fp.Skip())
+                    return false;
+            }
+            if (!has_room || !has_uid)
+                return false;
+            if (op == Optype::PUT_CHESS)
+                return has_row && has_col;
+            return has_msg;
+        }
+
+        /*{"optype":..,"result":..,"reason":..}*/
+        inline JsonBuf &EncodeResult(JsonBuf &buf, const char *optype, size_t optype_len, bool result, const char *reason)
+        {
+            return buf.Begin().Str("optype", optype, optype_len).Bool("result", result).Str("reason", reason).End();
+        }
+        /*put_chess的响应：请求字段 + result/reason/winner*/
+        inline JsonBuf &EncodePutChess(JsonBuf &buf, const RoomMsg &req, bool result, const char *reason, uint64_t winner)
+        {
+            return buf.Begin()
+                .Str("optype", "put_chess")
+                .Uint("room_id", req.roomId)
+                .Uint("uid", req.uid)
+                .Int("row", req.row)
+                .Int("col", req.col)
+                .Bool("result", result)
+                .Str("reason", reason)
+                .Uint("winner", winner)
+                .End();
+        }
+        /*chat的响应：请求字段 + result*/
+        inline JsonBuf &EncodeChat(JsonBuf &buf, const RoomMsg &req)
+        {
+            return buf.Begin()
+                .Str("optype", "chat")
+                .Uint("room_id", req.roomId)
+                .Uint("uid", req.uid)
+                .Str("message", req.message.data, req.message.len)
+                .Bool("result", true)
+                .End();
+        }
+        /*room_ready的响应*/
+        inline JsonBuf &EncodeRoomReady(JsonBuf &buf, uint64_t rid, uint64_t uid, uint64_t white, uint64_t black)
+        {
+            return buf.Begin()
+                .Str("optype", "room_ready")
+                .Bool("result", true)
+                .Uint("room_id", rid)
+                .Uint("uid", uid)
+                .Uint("white_id", white)
+                .Uint("black_id", black)
+                .End();
+        }
+        /*match_success的响应内容固定*/
+        inline const char *MatchSuccess(size_t &len)
+        {
+            static const char body[] = "{\"optype\":\"match_success\",\"result\":true}";
+            len = sizeof(body) - 1;
+            return body;
+        }
+    }
+}
+
+#endif
@@ -1,24 +1,41 @@
 #ifndef _DATABASE_HPP_
 #define _DATABASE_HPP_
 
-#include "util.hpp"
-#include <mutex>
+#include "mysqlUserStore.hpp"
+#include "memoryUserStore.hpp"
+#include "dbExecutor.hpp"
+#include <atomic>
+#include <memory>
 namespace gomoku
 {
-    /// @brief 对于MySQL用户表的操作
+    /// @brief 对于用户表的操作
+    /// 数据实际保存在UserStore后端中，UserTable负责缓存和在途请求统计
     class UserTable
     {
     private:
-        MYSQL *_mysql;
-        std::mutex _mtx;
+        std::unique_ptr<UserStore> _store; // 存储后端
+        UserCache _cache; // 按id查询用户信息时优先读缓存
+        std::atomic<int> _inflight{0}; // 正在执行(含等锁)的数据库请求数，供过载控制使用
+
+        /*统计在途请求数*/
+        struct InflightGuard
+        {
+            std::atomic<int> &_cnt;
+            InflightGuard(std::atomic<int> &cnt) : _cnt(cnt) { _cnt++; }
+            ~InflightGuard() { _cnt--; }
+        };
 
     public:
         // 主机、端口、MySQL用户名、MySQL密码、数据库名
         UserTable(const char *host, uint16_t port, const char *mysql_usr, const char *mysql_pwd, const char *db_name)
+            : _store(new MysqlUserStore(host, port, mysql_usr, mysql_pwd, db_name))
+        {
+            std::cout << "UserTable模块初始化完毕";
+        }
+        // 使用指定的存储后端
+        UserTable(std::unique_ptr<UserStore> store)
+            : _store(std::move(store))
         {
-            std::cout << "Connecting to mysql...\n";
-            _mysql = util::mysql::create(host, port, mysql_usr, mysql_pwd, db_name);
-            assert(_mysql != NULL);
             std::cout << "UserTable模块初始化完毕";
         }
         /// 用户注册，新增一个user
@@ -30,11 +47,12 @@ namespace gomoku
                 mylog::ERROR_LOG("INPUT PASSWORD OR USERNAME");
                 return false;
             }
-#define INSERT_USER "insert user values(null, '%s', password('%s'), 1000, 0, 0);"
-            char sql[4096] = {0};
-            sprintf(sql, INSERT_USER, usr["username"].asCString(), usr["password"].asCString());
-            bool ret = util::mysql::exec(_mysql, sql);
-            if (ret == false)
+            return AddtUser(usr["username"].asString(), usr["password"].asString());
+        }
+        bool AddtUser(const std::string &username, const std::string &password)
+        {
+            InflightGuard guard(_inflight);
+            if (_store->Insert(username, password) == false)
             {
                 mylog::ERROR_LOG("insert user info failed!!\n");
                 return false;
@@ -53,124 +71,80 @@ namespace gomoku
                 mylog::ERROR_LOG("INPUT PASSWORD OR USERNAME");
                 return false;
             }
-#define LOGIN_USER "select id, score, pk_cnt, win_cnt from user where username='%s' and password=password('%s');"
-            char sql[4096] = {0};
-            sprintf(sql, LOGIN_USER, usr["username"].asCString(), usr["password"].asCString());
-            MYSQL_RES *res = NULL;
+            UserRecord rec;
+            if (SelectByUsrPwd(usr["username"].asString(), usr["password"].asString(), rec) == false)
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                bool ret = util::mysql::exec(_mysql, sql);
-                if (ret == false)
-                {
-                    mylog::ERROR_LOG("user login failed!!\n");
-                    return false;
-                }
-                // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
-                res = mysql_store_result(_mysql);
-                if (res == NULL)
-                {
-                    mylog::ERROR_LOG("have no login user info!!");
-                    return false;
-                }
-            }
-            int row_num = mysql_num_rows(res);
-            if (row_num != 1)
-            {
-                mylog::ERROR_LOG("the user information queried is not unique!!");
+                mylog::ERROR_LOG("user login failed!!\n");
                 return false;
             }
-            MYSQL_ROW row = mysql_fetch_row(res);
-            usr["id"] = (Json::UInt64)std::stol(row[0]);
-            usr["score"] = (Json::UInt64)std::stol(row[1]);
-            usr["pk_cnt"] = std::stoi(row[2]);
-            usr["win_cnt"] = std::stoi(row[3]);
-            mysql_free_result(res);
+            usr["id"] = (Json::UInt64)rec.id;
+            usr["score"] = rec.score;
+            usr["pk_cnt"] = rec.pkCnt;
+            usr["win_cnt"] = rec.winCnt;
             return true;
         }
+        bool SelectByUsrPwd(const std::string &username, const std::string &password, UserRecord &rec)
+        {
+            InflightGuard guard(_inflight);
+            return _store->SelectByUsrPwd(username, password, rec);
+        }
         /// 根据id，获取user详细信息
         bool SelectById(uint64_t id, Json::Value &user)
         {
-#define USER_BY_ID "select username, score, pk_cnt, win_cnt from user where id=%ld;"
-            char sql[4096] = {0};
-            sprintf(sql, USER_BY_ID, id);
-            MYSQL_RES *res = NULL;
-            {
-                std::unique_lock<std::mutex> lock(_mtx);
-                bool ret = util::mysql::exec(_mysql, sql);
-                if (ret == false)
-                {
-                    mylog::ERROR_LOG("get user by id failed!!\n");
-                    return false;
-                }
-                // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
-                res = mysql_store_result(_mysql);
-                if (res == NULL)
-                {
-                    mylog::ERROR_LOG("have no user info!!");
-                    return false;
-                }
-            }
-            int row_num = mysql_num_rows(res);
-            if (row_num != 1)
+            UserRecord rec;
+            if (SelectById(id, rec) == false)
             {
-                mylog::ERROR_LOG("the user information queried is not unique!!");
+                mylog::ERROR_LOG("get user by id failed!!\n");
                 return false;
             }
-            MYSQL_ROW row = mysql_fetch_row(res);
-            user["id"] = (Json::UInt64)id;
-            user["username"] = row[0];
-            user["score"] = (Json::UInt64)std::stol(row[1]);
-            user["pk_cnt"] = std::stoi(row[2]);
-            user["win_cnt"] = std::stoi(row[3]);
-            mysql_free_result(res);
+            __ToJson(rec, user);
+            return true;
+        }
+        /// 只查缓存，不访问数据库
+        bool SelectCached(uint64_t id, UserRecord &rec)
+        {
+            uint64_t version = 0;
+            return _cache.Get(id, rec, version);
+        }
+        bool SelectById(uint64_t id, UserRecord &rec)
+        {
+            uint64_t version = 0;
+            if (_cache.Get(id, rec, version))
+                return true;
+            InflightGuard guard(_inflight);
+            bool fresh = true;
+            if (_store->SelectById(id, rec, fresh) == false)
+                return false;
+            // 从库的结果可能落后于主库，放入缓存后会一直保留到下一次写入，因此只缓存主库的结果
+            if (fresh)
+                _cache.Put(rec, version);
             return true;
         }
 
         /// 根据用户名，获取user详细信息
         bool SelectByName(const std::string &name, Json::Value &user)
         {
-#define USER_BY_NAME "select id, score, pk_cnt, win_cnt from user where username='%s';"
-            char sql[4096] = {0};
-            sprintf(sql, USER_BY_NAME, name.c_str());
-            MYSQL_RES *res = NULL;
-            {
-                std::unique_lock<std::mutex> lock(_mtx);
-                bool ret = util::mysql::exec(_mysql, sql);
-                if (ret == false)
-                {
-                    mylog::ERROR_LOG("get user by name failed!!\n");
-                    return false;
-                }
-                // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
-                res = mysql_store_result(_mysql);
-                if (res == NULL)
-                {
-                    mylog::ERROR_LOG("have no user info!!");
-                    return false;
-                }
-            }
-            int row_num = mysql_num_rows(res);
-            if (row_num != 1)
+            UserRecord rec;
+            if (SelectByName(name, rec) == false)
             {
-                mylog::ERROR_LOG("the user information queried is not unique!!");
+                mylog::ERROR_LOG("get user by name failed!!\n");
                 return false;
             }
-            MYSQL_ROW row = mysql_fetch_row(res);
-            user["id"] = (Json::UInt64)std::stol(row[0]);
-            user["username"] = name;
-            user["score"] = (Json::UInt64)std::stol(row[1]);
-            user["pk_cnt"] = std::stoi(row[2]);
-            user["win_cnt"] = std::stoi(row[3]);
-            mysql_free_result(res);
+            __ToJson(rec, user);
             return true;
         }
+        bool SelectByName(const std::string &name, UserRecord &rec)
+        {
+            InflightGuard guard(_inflight);
+            return _store->SelectByName(name, rec);
+        }
         /// 某个user赢了，修改他的分数和比赛场次
         bool Win(uint64_t id)
         {
-#define USER_WIN "update user set score=score+30, pk_cnt=pk_cnt+1, win_cnt=win_cnt+1 where id=%ld;"
-            char sql[4096] = {0};
-            sprintf(sql, USER_WIN, id);
-            bool ret = util::mysql::exec(_mysql, sql);
+            InflightGuard guard(_inflight);
+            _cache.BeginUpdate(id);
+            bool ret = _store->Win(id);
+            _cache.EndUpdate(id, true, ret);
             if (ret == false)
             {
                 mylog::ERROR_LOG("update win user info failed!!\n");
@@ -181,10 +155,10 @@ namespace gomoku
         /// 某个user输了，修改他的分数和比赛场次
         bool Lose(uint64_t id)
         {
-#define USER_LOSE "update user set score=score-30, pk_cnt=pk_cnt+1 where id=%ld;"
-            char sql[4096] = {0};
-            sprintf(sql, USER_LOSE, id);
-            bool ret = util::mysql::exec(_mysql, sql);
+            InflightGuard guard(_inflight);
+            _cache.BeginUpdate(id);
+            bool ret = _store->Lose(id);
+            _cache.EndUpdate(id, false, ret);
             if (ret == false)
             {
                 mylog::ERROR_LOG("update lose user info failed!!\n");
@@ -192,7 +166,130 @@ namespace gomoku
             }
             return true;
         }
+        /// 幂等地应用一局的结果，(epoch, seq)重复时不修改数据
+        bool ApplyGameResult(uint64_t epoch, uint64_t seq, uint64_t winner, uint64_t loser)
+        {
+            InflightGuard guard(_inflight);
+            bool duplicate = false;
+            _cache.BeginUpdate(winner);
+            _cache.BeginUpdate(loser);
+            bool ret = _store->ApplyGameResult(epoch, seq, winner, loser, duplicate);
+            // 重复的结果已经体现在数据库中，缓存里的记录可能是之后读到的，不能再加一次，直接删除
+            _cache.EndUpdate(winner, true, ret && !duplicate);
+            _cache.EndUpdate(loser, false, ret && !duplicate);
+            if (ret == false)
+                mylog::ERROR_LOG("apply game result failed, epoch: %lu, seq: %lu", epoch, seq);
+            return ret;
+        }
+        /// 当前在途的数据库请求数
+        int Inflight()
+        {
+            return _inflight.load(std::memory_order_relaxed);
+        }
+        /// 存储后端，用于查看统计信息
+        UserStore &Store()
+        {
+            return *_store;
+        }
+        /// 用户信息缓存，用于查看统计信息
+        UserCache &Cache()
+        {
+            return _cache;
+        }
+
+    private:
+        static void __ToJson(const UserRecord &rec, Json::Value &user)
+        {
+            user["id"] = (Json::UInt64)rec.id;
+            user["username"] = rec.username;
+            user["score"] = rec.score;
+            user["pk_cnt"] = rec.pkCnt;
+            user["win_cnt"] = rec.winCnt;
+        }
+    };
+
+    /// @brief UserTable的异步接口
+    /// 数据库调用在DbExecutor的工作线程中执行，回调在io线程中执行，io线程不会被数据库阻塞。
+    /// 所有接口都需要在io线程中调用
+    class AsyncUserTable
+    {
+    public:
+        using record_cb_t = std::function<void(DbStatus, UserRecord &)>;
+        using status_cb_t = std::function<void(DbStatus)>;
+
+    private:
+        UserTable *_ut;
+        DbExecutor _exec;
+
+    public:
+        AsyncUserTable(UserTable *ut, wsserver_t *server)
+            : _ut(ut), _exec(server)
+        {
+        }
+        /// 排队中和执行中的数据库请求数
+        int Depth() const
+        {
+            return _exec.Depth();
+        }
+        void SelectById(uint64_t id, record_cb_t cb, const DbCallOptions &opt = DbCallOptions())
+        {
+            // 缓存命中时不需要经过工作线程，直接投递回调
+            std::shared_ptr<UserRecord> rec = std::make_shared<UserRecord>();
+            if (_ut->SelectCached(id, *rec))
+                return __Post(opt, [cb, rec]() { cb(DbStatus::OK, *rec); });
+            UserTable *ut = _ut;
+            _exec.Submit<UserRecord>([ut, id](UserRecord &r) { return ut->SelectById(id, r); }, cb, opt);
+        }
+        void SelectByUsrPwd(const std::string &username, const std::string &password, record_cb_t cb,
+                            const DbCallOptions &opt = DbCallOptions())
+        {
+            UserTable *ut = _ut;
+            _exec.Submit<UserRecord>([ut, username, password](UserRecord &r) { return ut->SelectByUsrPwd(username, password, r); },
+                                     cb, opt);
+        }
+        void AddtUser(const std::string &username, const std::string &password, status_cb_t cb,
+                      const DbCallOptions &opt = DbCallOptions())
+        {
+            UserTable *ut = _ut;
+            __Submit([ut, username, password]() { return ut->AddtUser(username, password); }, cb, opt);
+        }
+        /// 对局结果，cb为空时只在失败时记录日志
+        void Win(uint64_t id, status_cb_t cb = nullptr, const DbCallOptions &opt = DbCallOptions())
+        {
+            UserTable *ut = _ut;
+            __Submit([ut, id]() { return ut->Win(id); }, __OrLog(cb, "win", id), opt);
+        }
+        void Lose(uint64_t id, status_cb_t cb = nullptr, const DbCallOptions &opt = DbCallOptions())
+        {
+            UserTable *ut = _ut;
+            __Submit([ut, id]() { return ut->Lose(id); }, __OrLog(cb, "lose", id), opt);
+        }
+
+    private:
+        /*写操作：开始执行后不再超时或取消，回调一定是真实结果*/
+        void __Submit(std::function<bool()> work, status_cb_t cb, const DbCallOptions &opt)
+        {
+            DbCallOptions wopt = opt;
+            wopt.idempotent = false;
+            _exec.Submit<bool>([work](bool &) { return work(); }, [cb](DbStatus st, bool &) { cb(st); }, wopt);
+        }
+        void __Post(const DbCallOptions &opt, std::function<void()> fn)
+        {
+            if (opt.strand)
+                opt.strand->post(fn);
+            else
+                _exec.IoService().post(fn);
+        }
+        static status_cb_t __OrLog(status_cb_t cb, const char *what, uint64_t id)
+        {
+            if (cb)
+                return cb;
+            return [what, id](DbStatus st) {
+                if (st != DbStatus::OK)
+                    mylog::ERROR_LOG("async %s failed, uid: %lu, status: %d", what, id, (int)st);
+            };
+        }
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,281 @@
+#ifndef _DBEXECUTOR_HPP_
+#define _DBEXECUTOR_HPP_
+/**
+ * 数据库执行器：一组专门执行阻塞数据库调用的工作线程。
+ * 调用者提交 work(在工作线程执行) 和 done(完成回调)，done 被投递回服务器的 io_service
+ * (或调用者指定的 strand)执行，因此回调里可以直接操作连接和会话，不需要额外加锁，
+ * 事件循环也不会被数据库阻塞。
+ * - 超时/取消：到期或 CancelToken::Cancel() 时，还在排队的任务不再执行，done 立即以 TIMEOUT/CANCELLED 回调；
+ *   已经开始执行的只读调用同样立即回调，之后的结果被丢弃；
+ *   不可重复执行的写操作(DbCallOptions::idempotent=false)开始执行后不再超时或取消，done 一定是真实结果，
+ *   避免写入已经提交、调用者却以为失败而重试
+ */
+#include "util.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gomoku
+{
+    /*异步数据库调用的结果*/
+    enum class DbStatus
+    {
+        OK,
+        FAILED,    // 执行失败或查询不到数据
+        TIMEOUT,   // 超时
+        CANCELLED, // 被调用者取消
+        REJECTED   // 队列已满，没有执行
+    };
+
+    /*执行器参数，需要在创建执行器之前设置*/
+    struct DbExecutorOptions
+    {
+        size_t threads = 4;          // 工作线程数，一般不超过连接池上限
+        size_t maxQueue = 1024;      // 排队任务上限，超过后直接以REJECTED回调
+        int defaultTimeoutMs = 3000; // 调用者没有指定超时时间时使用
+
+        static DbExecutorOptions &Instance()
+        {
+            static DbExecutorOptions opt;
+            return opt;
+        }
+    };
+
+    /*取消令牌，调用者和执行器通过shared_ptr共享。一个令牌可以用于多次调用，例如绑定到一个连接上*/
+    class CancelToken
+    {
+    private:
+        std::atomic<bool> _cancelled{false};
+        std::mutex _mtx;
+        uint64_t _nextId = 1;
+        std::map<uint64_t, std::function<void()>> _callbacks; // 取消时在调用Cancel()的线程中执行
+
+    public:
+        void Cancel()
+        {
+            std::map<uint64_t, std::function<void()>> cbs;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_cancelled.exchange(true))
+                    return;
+                cbs.swap(_callbacks);
+            }
+            for (auto &it : cbs)
+                it.second();
+        }
+        bool Cancelled() const { return _cancelled.load(); }
+        /// 登记取消时的回调，返回的id用于Forget；已经取消时直接执行并返回0
+        uint64_t OnCancel(std::function<void()> cb)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (!_cancelled.load())
+                {
+                    _callbacks[_nextId] = cb;
+                    return _nextId++;
+                }
+            }
+            cb();
+            return 0;
+        }
+        /// 调用已经完成，不再需要回调
+        void Forget(uint64_t id)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _callbacks.erase(id);
+        }
+    };
+
+    /*单次调用的选项*/
+    struct DbCallOptions
+    {
+        int timeoutMs = 0;                                        // 0表示使用DbExecutorOptions::defaultTimeoutMs
+        std::shared_ptr<CancelToken> cancel;                      // 为空表示不可取消
+        bool idempotent = true;                                   // false表示开始执行后不再超时或取消
+        websocketpp::lib::asio::io_service::strand *strand = nullptr; // 不为空时回调投递到该strand
+    };
+
+    class DbExecutor
+    {
+    private:
+        typedef websocketpp::lib::asio::steady_timer timer_t;
+
+        wsserver_t *_server;
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::deque<std::function<void()>> _tasks;
+        std::vector<std::thread> _threads;
+        std::atomic<int> _depth{0}; // 排队中 + 执行中的任务数
+        bool _stop = false;
+
+        /*调用的阶段*/
+        enum Stage
+        {
+            QUEUED,  // 排队中
+            RUNNING, // 工作线程正在执行
+            ABORTED  // 开始执行前已经超时或取消，不再执行
+        };
+
+        /*一次调用的共享状态，完成、超时、取消谁先发生谁回调，只回调一次*/
+        template <typename Result>
+        struct Call
+        {
+            std::atomic<bool> finished{false};
+            std::atomic<int> stage{QUEUED};
+            bool idempotent = true;
+            Result result;
+            std::function<void(DbStatus, Result &)> done;
+            std::chrono::steady_clock::time_point deadline;
+            std::shared_ptr<CancelToken> cancel;
+            std::atomic<uint64_t> cancelId{0};
+            websocketpp::lib::asio::io_service::strand *strand = nullptr;
+            std::shared_ptr<timer_t> timer;
+        };
+
+    public:
+        DbExecutor(wsserver_t *server) : _server(server)
+        {
+            size_t n = DbExecutorOptions::Instance().threads;
+            for (size_t i = 0; i < (n == 0 ? 1 : n); ++i)
+                _threads.push_back(std::thread(&DbExecutor::__Run, this));
+            mylog::INFO_LOG("数据库执行器初始化完成，线程数: %lu", _threads.size());
+        }
+        ~DbExecutor()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _cond.notify_all();
+            for (std::thread &t : _threads)
+                t.join();
+        }
+        websocketpp::lib::asio::io_service &IoService()
+        {
+            return _server->get_io_service();
+        }
+        /// 排队中和执行中的任务数，供过载控制使用
+        int Depth() const
+        {
+            return _depth.load(std::memory_order_relaxed);
+        }
+
+        /*
+            提交一次数据库调用：work在工作线程执行，返回false表示失败；
+            done在io线程(或opt.strand)执行，每次调用恰好回调一次。
+            需要在io线程中调用，超时定时器与回调在同一个线程上操作
+        */
+        template <typename Result>
+        void Submit(std::function<bool(Result &)> work, std::function<void(DbStatus, Result &)> done,
+                    const DbCallOptions &opt = DbCallOptions())
+        {
+            int timeout = opt.timeoutMs > 0 ? opt.timeoutMs : DbExecutorOptions::Instance().defaultTimeoutMs;
+            std::shared_ptr<Call<Result>> call = std::make_shared<Call<Result>>();
+            call->done = done;
+            call->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+            call->cancel = opt.cancel;
+            call->idempotent = opt.idempotent;
+            call->strand = opt.strand;
+            call->timer = std::make_shared<timer_t>(_server->get_io_service(), std::chrono::milliseconds(timeout));
+            // 先登记取消回调再入队，工作线程完成时一定能拿到cancelId并注销
+            if (call->cancel)
+                call->cancelId = call->cancel->OnCancel([this, call]() { __Abort(call, DbStatus::CANCELLED); });
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_tasks.size() >= DbExecutorOptions::Instance().maxQueue)
+                {
+                    lock.unlock();
+                    mylog::ERROR_LOG("数据库执行器队列已满");
+                    return __Finish(call, DbStatus::REJECTED);
+                }
+                _depth++;
+                _tasks.push_back([this, call, work]() {
+                    // 已经以超时/取消回调过的任务不再执行
+                    int stage = QUEUED;
+                    if (!call->stage.compare_exchange_strong(stage, RUNNING))
+                        return;
+                    DbStatus st = DbStatus::OK;
+                    if (call->cancel && call->cancel->Cancelled())
+                        st = DbStatus::CANCELLED;
+                    else if (std::chrono::steady_clock::now() >= call->deadline)
+                        st = DbStatus::TIMEOUT;
+                    if (st != DbStatus::OK)
+                    {
+                        call->stage.store(ABORTED);
+                        return __Finish(call, st);
+                    }
+                    bool ok = work(call->result);
+                    __Finish(call, ok ? DbStatus::OK : DbStatus::FAILED);
+                });
+            }
+            _cond.notify_one();
+            // 到期或取消时如果还没有结果，立即回调
+            call->timer->async_wait([this, call](const websocketpp::lib::asio::error_code &ec) {
+                if (!ec)
+                    __Abort(call, DbStatus::TIMEOUT);
+            });
+        }
+
+    private:
+        void __Run()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _cond.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+                    if (_stop && _tasks.empty())
+                        return;
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+                _depth--;
+            }
+        }
+        /*
+            超时或取消：还在排队时标记为不再执行并回调；正在执行时，只读调用直接回调、丢弃之后的结果，
+            写操作等待真实结果
+        */
+        template <typename Result>
+        void __Abort(std::shared_ptr<Call<Result>> call, DbStatus status)
+        {
+            int stage = QUEUED;
+            if (call->stage.compare_exchange_strong(stage, ABORTED) || stage == ABORTED ||
+                (stage == RUNNING && call->idempotent))
+                __Finish(call, status);
+        }
+        /*把结果投递回io线程，只有第一次调用生效*/
+        template <typename Result>
+        void __Finish(std::shared_ptr<Call<Result>> call, DbStatus status)
+        {
+            if (call->finished.exchange(true))
+                return;
+            // 令牌可能比这次调用活得久，去掉登记的回调，也断开令牌到call的引用
+            if (call->cancel && call->cancelId.load() != 0)
+                call->cancel->Forget(call->cancelId.load());
+            auto fn = [call, status]() {
+                if (call->timer)
+                    call->timer->cancel();
+                if (status == DbStatus::OK || status == DbStatus::FAILED)
+                    return call->done(status, call->result);
+                // 超时时工作线程可能还在写result，回调拿到的是一个空结果
+                Result empty;
+                call->done(status, empty);
+            };
+            if (call->strand)
+                call->strand->post(fn);
+            else
+                _server->get_io_service().post(fn);
+        }
+    };
+}
+
+#endif
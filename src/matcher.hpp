@@ -125,13 +125,10 @@ namespace gomoku
                     continue;
                 }
                 // 5.发送响应给两个玩家
-                Json::Value resp;
-                resp["optype"] = "match_success";
-                resp["result"] = true;
-                std::string body;
-                util::json::serialize(resp, body);
-                conn1->send(body);
-                conn2->send(body);
+                size_t len = 0;
+                const char *body = codec::MatchSuccess(len);
+                util::ws::send(conn1, body, len);
+                util::ws::send(conn2, body, len);
             }
         }
         /*线程入口函数*/
@@ -158,14 +155,14 @@ namespace gomoku
         bool Add(uint64_t uid)
         {
             // 1.获取玩家信息
-            Json::Value user;
+            UserRecord user;
             bool ret = _ut->SelectById(uid, user);
             if (ret == false)
             {
                 mylog::INFO_LOG("获取玩家信息失败，uid: %d", uid);
                 return false;
             }
-            int score = user["score"].asInt();
+            int score = user.score;
             // 2.添加到对应队列
             if (score < BRONZE_SCORE)
                 _bronzeQueue.Push(uid);
@@ -179,14 +176,14 @@ namespace gomoku
         bool Del(uint64_t uid)
         {
             // 1.获取玩家信息
-            Json::Value user;
+            UserRecord user;
             bool ret = _ut->SelectById(uid, user);
             if (ret == false)
             {
                 mylog::INFO_LOG("获取玩家信息失败，uid: %d", uid);
                 return false;
             }
-            int score = user["score"].asInt();
+            int score = user.score;
             // 2.删除对应队列中的数据
             if (score < BRONZE_SCORE)
                 _bronzeQueue.Remove(uid);
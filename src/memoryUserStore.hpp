@@ -0,0 +1,258 @@
+#ifndef _MEMORYUSERSTORE_HPP_
+#define _MEMORYUSERSTORE_HPP_
+/**
+ * 进程内的用户存储，不依赖MySQL，用于在隔离环境中运行完整的服务器做压测。
+ * - 数据保存在内存中；配置了WAL文件时，每次修改追加一行日志，启动时重放恢复
+ * - 可以给每次调用注入固定延迟+随机抖动，模拟不同的数据库响应时间
+ * 密码只保存哈希值，但不是安全的口令哈希，不要用于线上环境。
+ */
+#include "userStore.hpp"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace gomoku
+{
+    /*进程内存储参数，需要在创建存储之前设置*/
+    struct MemoryStoreOptions
+    {
+        std::string walPath;  // WAL文件路径，为空时不持久化
+        bool walSync = false; // 每次写WAL后是否fsync
+        int latencyUs = 0;    // 每次调用注入的固定延迟
+        int jitterUs = 0;     // 在固定延迟之上再加 [0, jitterUs) 的随机延迟
+
+        static MemoryStoreOptions &Instance()
+        {
+            static MemoryStoreOptions opt;
+            return opt;
+        }
+    };
+
+    class MemoryUserStore : public UserStore
+    {
+    private:
+        std::mutex _mtx;
+        std::unordered_map<uint64_t, UserRecord> _users;
+        std::unordered_map<uint64_t, size_t> _passwords; // id -> 密码哈希
+        std::unordered_map<std::string, uint64_t> _names;
+        uint64_t _nextId = 1;
+        std::unordered_map<uint64_t, uint64_t> _appliedSeq; // 纪元 -> 已经应用的最大序号，纪元内按序号顺序重放
+        FILE *_wal = nullptr;
+
+    public:
+        MemoryUserStore()
+        {
+            const MemoryStoreOptions &opt = MemoryStoreOptions::Instance();
+            if (!opt.walPath.empty())
+            {
+                __Replay(opt.walPath);
+                _wal = fopen(opt.walPath.c_str(), "a");
+                if (_wal == nullptr)
+                    mylog::ERROR_LOG("打开WAL文件失败: %s", opt.walPath.c_str());
+            }
+            mylog::INFO_LOG("进程内用户存储初始化完成，用户数: %lu", _users.size());
+        }
+        virtual ~MemoryUserStore()
+        {
+            if (_wal)
+                fclose(_wal);
+        }
+        virtual bool Insert(const std::string &username, const std::string &password)
+        {
+            __Delay();
+            if (username.empty() || username.size() > 255 || username.find('\n') != std::string::npos)
+                return false;
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (_names.count(username))
+                return false;
+            uint64_t id = _nextId;
+            size_t hash = __Hash(password);
+            __Insert(id, username, hash);
+            __Log("I %lu %zu %s\n", id, hash, username.c_str());
+            return true;
+        }
+        virtual bool SelectByUsrPwd(const std::string &username, const std::string &password, UserRecord &rec)
+        {
+            __Delay();
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _names.find(username);
+            if (it == _names.end() || _passwords[it->second] != __Hash(password))
+                return false;
+            rec = _users[it->second];
+            return true;
+        }
+        using UserStore::SelectById;
+        virtual bool SelectById(uint64_t id, UserRecord &rec)
+        {
+            __Delay();
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _users.find(id);
+            if (it == _users.end())
+                return false;
+            rec = it->second;
+            return true;
+        }
+        virtual bool SelectByName(const std::string &name, UserRecord &rec)
+        {
+            __Delay();
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _names.find(name);
+            if (it == _names.end())
+                return false;
+            rec = _users[it->second];
+            return true;
+        }
+        virtual bool Win(uint64_t id)
+        {
+            __Delay();
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (!__Apply(id, true))
+                return false;
+            __Log("W %lu\n", id);
+            return true;
+        }
+        virtual bool Lose(uint64_t id)
+        {
+            __Delay();
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (!__Apply(id, false))
+                return false;
+            __Log("L %lu\n", id);
+            return true;
+        }
+        virtual bool ApplyGameResult(uint64_t epoch, uint64_t seq, uint64_t winner, uint64_t loser, bool &duplicate)
+        {
+            __Delay();
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _appliedSeq.find(epoch);
+            duplicate = (it != _appliedSeq.end() && seq <= it->second);
+            if (duplicate)
+                return true;
+            __ApplyGame(epoch, seq, winner, loser);
+            __Log("G %lu %lu %lu %lu\n", epoch, seq, winner, loser);
+            return true;
+        }
+        virtual void PruneApplied(uint64_t epoch)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (_appliedSeq.erase(epoch) > 0)
+                __Log("P %lu\n", epoch);
+        }
+        virtual void Stats(Json::Value &out)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            out["backend"] = "memory";
+            out["users"] = (Json::UInt64)_users.size();
+            out["wal"] = MemoryStoreOptions::Instance().walPath;
+        }
+
+    private:
+        static size_t __Hash(const std::string &password)
+        {
+            return std::hash<std::string>()("gomoku:" + password);
+        }
+        void __Insert(uint64_t id, const std::string &username, size_t hash)
+        {
+            UserRecord rec;
+            rec.id = id;
+            rec.username = username;
+            rec.score = 1000;
+            _users[id] = rec;
+            _passwords[id] = hash;
+            _names[username] = id;
+            if (id >= _nextId)
+                _nextId = id + 1;
+        }
+        bool __Apply(uint64_t id, bool win)
+        {
+            auto it = _users.find(id);
+            if (it == _users.end())
+                return false;
+            it->second.score += win ? 30 : -30;
+            it->second.pkCnt++;
+            if (win)
+                it->second.winCnt++;
+            return true;
+        }
+        void __ApplyGame(uint64_t epoch, uint64_t seq, uint64_t winner, uint64_t loser)
+        {
+            __Apply(winner, true);
+            __Apply(loser, false);
+            _appliedSeq[epoch] = seq;
+        }
+        /*追加一行WAL，调用者持有_mtx*/
+        template <typename... Args>
+        void __Log(const char *fmt, Args... args)
+        {
+            if (_wal == nullptr)
+                return;
+            fprintf(_wal, fmt, args...);
+            fflush(_wal);
+            if (MemoryStoreOptions::Instance().walSync)
+                fsync(fileno(_wal));
+        }
+        /*启动时重放WAL*/
+        void __Replay(const std::string &path)
+        {
+            FILE *fp = fopen(path.c_str(), "r");
+            if (fp == nullptr)
+                return;
+            char line[512];
+            size_t n = 0;
+            long good = 0; // 最后一个完整行的结束位置
+            while (fgets(line, sizeof(line), fp))
+            {
+                size_t len = strlen(line);
+                if (len == 0 || line[len - 1] != '\n')
+                    break; // 最后一行可能没有写完整
+                good = ftell(fp);
+                uint64_t id = 0, epoch = 0, seq = 0, loser = 0;
+                size_t hash = 0;
+                int pos = 0;
+                // 用户名从hash后的唯一一个空格之后开始，用户名本身可能以空格开头，不能让sscanf跳过
+                if (line[0] == 'I' && sscanf(line, "I %lu %zu%n", &id, &hash, &pos) == 2 && line[pos] == ' ')
+                {
+                    ++pos;
+                    __Insert(id, std::string(line + pos, len - 1 - pos), hash);
+                }
+                else if ((line[0] == 'W' || line[0] == 'L') && sscanf(line + 1, " %lu", &id) == 1)
+                    __Apply(id, line[0] == 'W');
+                else if (line[0] == 'G' && sscanf(line, "G %lu %lu %lu %lu", &epoch, &seq, &id, &loser) == 4)
+                    __ApplyGame(epoch, seq, id, loser);
+                else if (line[0] == 'G' && sscanf(line, "G %lu %lu %lu", &seq, &id, &loser) == 3)
+                    __ApplyGame(0, seq, id, loser); // 旧格式，没有纪元
+                else if (line[0] == 'P' && sscanf(line, "P %lu", &epoch) == 1)
+                    _appliedSeq.erase(epoch);
+                else
+                    continue;
+                ++n;
+            }
+            fseek(fp, 0, SEEK_END);
+            bool torn = ftell(fp) > good;
+            fclose(fp);
+            // 截掉没写完整的最后一行，否则后续追加的记录会和它拼在同一行
+            if (torn && truncate(path.c_str(), good) != 0)
+                mylog::ERROR_LOG("截断WAL文件失败: %s", path.c_str());
+            mylog::INFO_LOG("重放WAL完成，记录数: %lu", n);
+        }
+        /*注入的延迟在锁外执行，模拟数据库的响应时间而不是串行化*/
+        void __Delay()
+        {
+            const MemoryStoreOptions &opt = MemoryStoreOptions::Instance();
+            if (opt.latencyUs <= 0 && opt.jitterUs <= 0)
+                return;
+            static thread_local std::mt19937 rng(std::random_device{}());
+            int us = opt.latencyUs;
+            if (opt.jitterUs > 0)
+                us += (int)(rng() % (unsigned)opt.jitterUs);
+            std::this_thread::sleep_for(std::chrono::microseconds(us));
+        }
+    };
+}
+
+#endif
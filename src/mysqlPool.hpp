@@ -0,0 +1,322 @@
+#ifndef _MYSQLPOOL_HPP_
+#define _MYSQLPOOL_HPP_
+/**
+ * MySQL连接池。
+ * 使用者通过Checkout()借出一个连接，Handle析构时自动归还，
+ * 不同线程的查询各自使用一条连接并行执行，不再排队等待同一个socket。
+ * - 池中至少保持minSize条连接，最多maxSize条，全部借出时等待归还，超时返回无效Handle
+ * - 空闲超过idlePingMs的连接在借出前先mysql_ping检查，失败则重连
+ * - 执行时遇到服务器断开(CR_SERVER_GONE_ERROR/CR_SERVER_LOST)会重连后重试一次
+ * - 预处理语句按编号缓存在连接上，每条连接只需prepare一次，重连时一起失效
+ */
+#include "util.hpp"
+#include <mysql/errmsg.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace gomoku
+{
+    /*连接池参数，需要在创建连接池(UserTable)之前设置*/
+    struct MysqlPoolOptions
+    {
+        size_t minSize = 2;          // 启动时建立、并始终保持的连接数
+        size_t maxSize = 8;          // 连接数上限
+        int idlePingMs = 30000;      // 空闲超过该时间的连接，借出前先检查是否可用
+        int checkoutTimeoutMs = 3000; // 连接全部借出时，最多等待的时间
+
+        static MysqlPoolOptions &Instance()
+        {
+            static MysqlPoolOptions opt;
+            return opt;
+        }
+    };
+
+    /*连接池统计*/
+    struct MysqlPoolStats
+    {
+        std::atomic<uint64_t> checkouts{0};  // 借出次数
+        std::atomic<uint64_t> waits{0};      // 需要等待其他线程归还的借出次数
+        std::atomic<uint64_t> waitUsTotal{0}; // 累计等待时间
+        std::atomic<uint64_t> waitUsMax{0};  // 最长一次等待时间
+        std::atomic<uint64_t> timeouts{0};   // 等待超时次数
+        std::atomic<uint64_t> pings{0};      // 空闲检查次数
+        std::atomic<uint64_t> reconnects{0}; // 重连次数
+    };
+
+    /*池中的一条连接*/
+    struct MysqlConn
+    {
+        MYSQL *mysql = nullptr;
+        std::chrono::steady_clock::time_point lastUsed;
+        std::vector<MYSQL_STMT *> stmts; // 按语句编号缓存的预处理语句
+
+        /*关闭缓存的预处理语句，需要在关闭连接之前调用*/
+        void CloseStmts()
+        {
+            for (MYSQL_STMT *stmt : stmts)
+                if (stmt != nullptr)
+                    mysql_stmt_close(stmt);
+            stmts.clear();
+        }
+    };
+
+    class MysqlPool
+    {
+    public:
+        /*借出的连接，析构时归还给连接池*/
+        class Handle
+        {
+        private:
+            MysqlPool *_pool;
+            MysqlConn *_conn;
+
+        public:
+            Handle(MysqlPool *pool, MysqlConn *conn) : _pool(pool), _conn(conn) {}
+            Handle(Handle &&other) : _pool(other._pool), _conn(other._conn) { other._conn = nullptr; }
+            Handle(const Handle &) = delete;
+            Handle &operator=(const Handle &) = delete;
+            ~Handle()
+            {
+                if (_conn)
+                    _pool->__Return(_conn);
+            }
+            bool Valid() const { return _conn != nullptr && _conn->mysql != nullptr; }
+            MYSQL *Get() const { return _conn->mysql; }
+            MysqlConn *Conn() const { return _conn; }
+            /// 执行sql语句，服务器断开时重连并重试一次。
+            /// 事务中的语句需要传retry=false，重连后的新连接已经不在原来的事务中
+            bool Exec(const std::string &sql, bool retry = true)
+            {
+                if (util::mysql::exec(_conn->mysql, sql))
+                    return true;
+                if (!retry || !MysqlPool::ServerGone(mysql_errno(_conn->mysql)) || !_pool->Reconnect(_conn))
+                    return false;
+                return util::mysql::exec(_conn->mysql, sql);
+            }
+            /**
+             * 执行编号为id的预处理语句，服务器断开时重连并重试一次。
+             * params为参数绑定；results不为空时绑定结果并缓存结果集，
+             * 调用者用mysql_stmt_fetch读取后，需要mysql_stmt_free_result释放。
+             * 失败返回nullptr。retry的含义同Exec
+             */
+            MYSQL_STMT *Execute(size_t id, const char *sql, MYSQL_BIND *params, MYSQL_BIND *results, bool retry = true)
+            {
+                unsigned int err = 0;
+                MYSQL_STMT *stmt = __Execute(id, sql, params, results, err);
+                if (stmt == nullptr && retry && MysqlPool::ServerGone(err) && _pool->Reconnect(_conn))
+                    stmt = __Execute(id, sql, params, results, err);
+                return stmt;
+            }
+
+        private:
+            /*取出缓存的预处理语句，没有则prepare一次*/
+            MYSQL_STMT *__Prepare(size_t id, const char *sql, unsigned int &err)
+            {
+                if (id >= _conn->stmts.size())
+                    _conn->stmts.resize(id + 1, nullptr);
+                if (_conn->stmts[id] != nullptr)
+                    return _conn->stmts[id];
+                MYSQL_STMT *stmt = mysql_stmt_init(_conn->mysql);
+                if (stmt == nullptr)
+                {
+                    err = mysql_errno(_conn->mysql);
+                    return nullptr;
+                }
+                if (mysql_stmt_prepare(stmt, sql, strlen(sql)) != 0)
+                {
+                    err = mysql_stmt_errno(stmt);
+                    mylog::ERROR_LOG("mysql prepare failed : %s, sql: %s", mysql_stmt_error(stmt), sql);
+                    mysql_stmt_close(stmt);
+                    return nullptr;
+                }
+                _conn->stmts[id] = stmt;
+                return stmt;
+            }
+            MYSQL_STMT *__Execute(size_t id, const char *sql, MYSQL_BIND *params, MYSQL_BIND *results, unsigned int &err)
+            {
+                MYSQL_STMT *stmt = __Prepare(id, sql, err);
+                if (stmt == nullptr)
+                    return nullptr;
+                auto start = QueryStats::Now(); // 计时包含取回结果集，不包含首次prepare
+                if ((params != nullptr && mysql_stmt_bind_param(stmt, params)) || mysql_stmt_execute(stmt) != 0 ||
+                    (results != nullptr && (mysql_stmt_bind_result(stmt, results) || mysql_stmt_store_result(stmt) != 0)))
+                {
+                    QueryStats::Global().Record((long)id, sql, start, 0, false);
+                    err = mysql_stmt_errno(stmt);
+                    mylog::ERROR_LOG("mysql stmt execute failed : %s, sql: %s", mysql_stmt_error(stmt), sql);
+                    mysql_stmt_free_result(stmt);
+                    return nullptr;
+                }
+                uint64_t rows = results != nullptr ? mysql_stmt_num_rows(stmt) : mysql_stmt_affected_rows(stmt);
+                QueryStats::Global().Record((long)id, sql, start, rows, true);
+                return stmt;
+            }
+        };
+
+    private:
+        std::string _host;
+        uint16_t _port;
+        std::string _user;
+        std::string _pwd;
+        std::string _db;
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::vector<MysqlConn *> _all;  // 所有连接
+        std::vector<MysqlConn *> _idle; // 空闲连接，后进先出，让少数连接保持活跃
+        size_t _creating = 0;           // 正在建立中的连接数，计入上限
+        MysqlPoolStats _stats;
+
+    public:
+        MysqlPool(const std::string &host, uint16_t port, const std::string &user,
+                  const std::string &pwd, const std::string &db)
+            : _host(host), _port(port), _user(user), _pwd(pwd), _db(db)
+        {
+            // 多线程使用客户端库之前，需要先完成库的初始化
+            mysql_library_init(0, NULL, NULL);
+            const MysqlPoolOptions &opt = MysqlPoolOptions::Instance();
+            for (size_t i = 0; i < opt.minSize; ++i)
+            {
+                MysqlConn *conn = new MysqlConn();
+                conn->mysql = util::mysql::create(_host, _port, _user, _pwd, _db);
+                conn->lastUsed = std::chrono::steady_clock::now();
+                _all.push_back(conn);
+                _idle.push_back(conn);
+            }
+            mylog::INFO_LOG("MySQL连接池初始化完成，连接数: %lu", _all.size());
+        }
+        ~MysqlPool()
+        {
+            for (MysqlConn *conn : _all)
+            {
+                conn->CloseStmts();
+                util::mysql::destroy(conn->mysql);
+                delete conn;
+            }
+        }
+
+        /*借出一个连接，超时或无法建立连接时返回的Handle无效*/
+        Handle Checkout()
+        {
+            const MysqlPoolOptions &opt = MysqlPoolOptions::Instance();
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = start + std::chrono::milliseconds(opt.checkoutTimeoutMs);
+            MysqlConn *conn = nullptr;
+            bool create = false;
+            bool waited = false;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                while (_idle.empty() && _all.size() + _creating >= opt.maxSize)
+                {
+                    waited = true;
+                    if (_cond.wait_until(lock, deadline) == std::cv_status::timeout && _idle.empty())
+                        break;
+                }
+                if (!_idle.empty())
+                {
+                    conn = _idle.back();
+                    _idle.pop_back();
+                }
+                else if (_all.size() + _creating < opt.maxSize)
+                {
+                    _creating++;
+                    create = true;
+                }
+            }
+            _stats.checkouts++;
+            if (waited)
+                __RecordWait(start);
+            if (create)
+                conn = __Create();
+            if (conn == nullptr)
+            {
+                _stats.timeouts++;
+                mylog::ERROR_LOG("获取MySQL连接失败");
+                return Handle(this, nullptr);
+            }
+            __CheckIdle(conn, opt.idlePingMs);
+            return Handle(this, conn);
+        }
+
+        /*关闭并重新建立连接*/
+        bool Reconnect(MysqlConn *conn)
+        {
+            _stats.reconnects++;
+            conn->CloseStmts();
+            util::mysql::destroy(conn->mysql);
+            conn->mysql = util::mysql::create(_host, _port, _user, _pwd, _db);
+            if (conn->mysql == nullptr)
+            {
+                mylog::ERROR_LOG("MySQL重连失败");
+                return false;
+            }
+            mylog::INFO_LOG("MySQL连接已重连");
+            return true;
+        }
+        /*错误码是否表示服务器已经断开*/
+        static bool ServerGone(unsigned int err)
+        {
+            return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+        }
+
+        const MysqlPoolStats &Stats() const { return _stats; }
+        /*当前连接总数和空闲连接数*/
+        void Size(size_t &total, size_t &idle)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            total = _all.size();
+            idle = _idle.size();
+        }
+
+    private:
+        /*建立新连接，在锁外执行，避免阻塞其他线程借还连接*/
+        MysqlConn *__Create()
+        {
+            MysqlConn *conn = new MysqlConn();
+            conn->mysql = util::mysql::create(_host, _port, _user, _pwd, _db);
+            std::unique_lock<std::mutex> lock(_mtx);
+            _creating--;
+            if (conn->mysql == nullptr)
+            {
+                delete conn;
+                _cond.notify_one(); // 名额空出来了，让等待者自己尝试
+                return nullptr;
+            }
+            _all.push_back(conn);
+            mylog::INFO_LOG("MySQL连接池扩容，连接数: %lu", _all.size());
+            return conn;
+        }
+        void __Return(MysqlConn *conn)
+        {
+            conn->lastUsed = std::chrono::steady_clock::now();
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _idle.push_back(conn);
+            }
+            _cond.notify_one();
+        }
+        /*连接空闲太久可能已经被服务器关闭，借出前先检查*/
+        void __CheckIdle(MysqlConn *conn, int idle_ping_ms)
+        {
+            if (conn->mysql != nullptr &&
+                std::chrono::steady_clock::now() - conn->lastUsed < std::chrono::milliseconds(idle_ping_ms))
+                return;
+            _stats.pings++;
+            if (conn->mysql == nullptr || mysql_ping(conn->mysql) != 0)
+                Reconnect(conn);
+        }
+        void __RecordWait(std::chrono::steady_clock::time_point start)
+        {
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            _stats.waits++;
+            _stats.waitUsTotal += us;
+            uint64_t max = _stats.waitUsMax.load();
+            while (us > max && !_stats.waitUsMax.compare_exchange_weak(max, us))
+                ;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef _MYSQLUSERSTORE_HPP_
+#define _MYSQLUSERSTORE_HPP_
+
+#include "userStore.hpp"
+#include "mysqlPool.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+namespace gomoku
+{
+    /*一个MySQL实例的连接信息*/
+    struct MysqlEndpoint
+    {
+        std::string host;
+        uint16_t port;
+        std::string user;
+        std::string pwd;
+        std::string db;
+    };
+
+    /*读写分离参数，需要在创建MysqlUserStore之前设置*/
+    struct ReplicaOptions
+    {
+        int readYourWritesMs = 6000; // 用户的对局结果写入主库后，该时间内对他的读请求仍然发往主库
+        int maxLagSec = 5;           // 复制延迟超过该值的从库不再接收读请求
+        int lagCheckMs = 1000;       // 检查从库复制延迟的间隔
+
+        /// 实际使用的读写窗口：不短于允许的最大复制延迟加一个检查间隔，
+        /// 否则窗口结束后仍可能读到还没复制到写入的从库
+        int WriteWindowMs() const
+        {
+            return std::max(readYourWritesMs, maxLagSec * 1000 + lagCheckMs);
+        }
+
+        static ReplicaOptions &Instance()
+        {
+            static ReplicaOptions opt;
+            return opt;
+        }
+    };
+
+    /// @brief MySQL用户表
+    /// 所有语句都是预处理语句，参数以二进制方式绑定，不再拼接sql字符串。
+    /// 写操作发往主库；只读查询在可用的从库中选择在途请求最少的一个，
+    /// 从库查不到数据时(可能是复制延迟)再查一次主库
+    class MysqlUserStore : public UserStore
+    {
+    private:
+        /*一个只读从库*/
+        struct Replica
+        {
+            std::string name; // host:port
+            std::unique_ptr<MysqlPool> pool;
+            std::atomic<int> outstanding{0};   // 在途的读请求数
+            std::atomic<int64_t> lagSec{-1};   // 复制延迟，-1表示未知或复制已中断
+            std::atomic<uint64_t> reads{0};
+        };
+
+        MysqlPool _pool; // 主库。每个请求借用一条独立的连接，不同线程的查询可以并行执行
+        std::vector<std::unique_ptr<Replica>> _replicas;
+        std::mutex _rywMtx;
+        std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> _recentWrites; // uid -> 读主库截止时间
+        std::atomic<uint64_t> _primaryReads{0};
+        std::atomic<uint64_t> _fallbacks{0}; // 从库查不到、改查主库的次数
+        std::mutex _lagMtx;
+        std::condition_variable _lagCond;
+        bool _stop = false;
+        std::thread _lagThread;
+
+        /*预处理语句编号，对应连接上缓存的语句*/
+        enum StmtId
+        {
+            STMT_INSERT_USER,
+            STMT_LOGIN_USER,
+            STMT_USER_BY_ID,
+            STMT_USER_BY_NAME,
+            STMT_USER_WIN,
+            STMT_USER_LOSE,
+            STMT_MARK_APPLIED,
+            STMT_PRUNE_APPLIED
+        };
+
+    public:
+        // 主机、端口、MySQL用户名、MySQL密码、数据库名
+        MysqlUserStore(const char *host, uint16_t port, const char *mysql_usr, const char *mysql_pwd, const char *db_name)
+            : _pool(host, port, mysql_usr, mysql_pwd, db_name)
+        {
+        }
+        // 一个主库 + 若干只读从库
+        MysqlUserStore(const MysqlEndpoint &primary, const std::vector<MysqlEndpoint> &replicas)
+            : _pool(primary.host, primary.port, primary.user, primary.pwd, primary.db)
+        {
+            for (const MysqlEndpoint &ep : replicas)
+            {
+                std::unique_ptr<Replica> r(new Replica());
+                r->name = ep.host + ":" + std::to_string(ep.port);
+                r->pool.reset(new MysqlPool(ep.host, ep.port, ep.user, ep.pwd, ep.db));
+                _replicas.push_back(std::move(r));
+            }
+            if (!_replicas.empty())
+                _lagThread = std::thread(&MysqlUserStore::__LagLoop, this);
+            mylog::INFO_LOG("MySQL读写分离初始化完成，从库数: %lu", _replicas.size());
+        }
+        virtual ~MysqlUserStore()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_lagMtx);
+                _stop = true;
+            }
+            _lagCond.notify_all();
+            if (_lagThread.joinable())
+                _lagThread.join();
+        }
+        virtual bool Insert(const std::string &username, const std::string &password)
+        {
+#define INSERT_USER "insert user values(null, ?, password(?), 1000, 0, 0);"
+            MYSQL_BIND params[2];
+            unsigned long name_len = username.size(), pwd_len = password.size();
+            util::mysql::bindString(params[0], username.c_str(), name_len, &name_len);
+            util::mysql::bindString(params[1], password.c_str(), pwd_len, &pwd_len);
+            return __Update(STMT_INSERT_USER, INSERT_USER, params);
+        }
+        virtual bool SelectByUsrPwd(const std::string &username, const std::string &password, UserRecord &rec)
+        {
+#define LOGIN_USER "select id, username, score, pk_cnt, win_cnt from user where username=? and password=password(?);"
+            MYSQL_BIND params[2];
+            unsigned long name_len = username.size(), pwd_len = password.size();
+            util::mysql::bindString(params[0], username.c_str(), name_len, &name_len);
+            util::mysql::bindString(params[1], password.c_str(), pwd_len, &pwd_len);
+            return __Read(0, STMT_LOGIN_USER, LOGIN_USER, params, rec);
+        }
+        virtual bool SelectById(uint64_t id, UserRecord &rec)
+        {
+            bool fresh;
+            return SelectById(id, rec, fresh);
+        }
+        virtual bool SelectById(uint64_t id, UserRecord &rec, bool &fresh)
+        {
+#define USER_BY_ID "select id, username, score, pk_cnt, win_cnt from user where id=?;"
+            MYSQL_BIND params[1];
+            util::mysql::bindUint64(params[0], &id);
+            return __Read(id, STMT_USER_BY_ID, USER_BY_ID, params, rec, &fresh);
+        }
+        virtual bool SelectByName(const std::string &name, UserRecord &rec)
+        {
+#define USER_BY_NAME "select id, username, score, pk_cnt, win_cnt from user where username=?;"
+            MYSQL_BIND params[1];
+            unsigned long name_len = name.size();
+            util::mysql::bindString(params[0], name.c_str(), name_len, &name_len);
+            return __Read(0, STMT_USER_BY_NAME, USER_BY_NAME, params, rec);
+        }
+        virtual bool Win(uint64_t id)
+        {
+#define USER_WIN "update user set score=score+30, pk_cnt=pk_cnt+1, win_cnt=win_cnt+1 where id=?;"
+            MYSQL_BIND params[1];
+            util::mysql::bindUint64(params[0], &id);
+            __MarkWritten(id);
+            return __Update(STMT_USER_WIN, USER_WIN, params);
+        }
+        virtual bool Lose(uint64_t id)
+        {
+#define USER_LOSE "update user set score=score-30, pk_cnt=pk_cnt+1 where id=?;"
+            MYSQL_BIND params[1];
+            util::mysql::bindUint64(params[0], &id);
+            __MarkWritten(id);
+            return __Update(STMT_USER_LOSE, USER_LOSE, params);
+        }
+        /*在一个事务中记录(epoch, seq)并更新双方数据，主键冲突说明已经应用过*/
+        virtual bool ApplyGameResult(uint64_t epoch, uint64_t seq, uint64_t winner, uint64_t loser, bool &duplicate)
+        {
+#define MARK_APPLIED "insert ignore into game_result_applied(epoch, seq) values(?, ?);"
+            duplicate = false;
+            __MarkWritten(winner);
+            __MarkWritten(loser);
+            MysqlPool::Handle h = _pool.Checkout();
+            if (!h.Valid() || !h.Exec("start transaction;"))
+                return false;
+            MYSQL_BIND params[2];
+            util::mysql::bindUint64(params[0], &epoch);
+            util::mysql::bindUint64(params[1], &seq);
+            MYSQL_STMT *stmt = h.Execute(STMT_MARK_APPLIED, MARK_APPLIED, params, nullptr, false);
+            if (stmt == nullptr)
+                return __Rollback(h);
+            if (mysql_stmt_affected_rows(stmt) == 0)
+            {
+                duplicate = true;
+                h.Exec("rollback;", false);
+                return true;
+            }
+            util::mysql::bindUint64(params[0], &winner);
+            if (h.Execute(STMT_USER_WIN, USER_WIN, params, nullptr, false) == nullptr)
+                return __Rollback(h);
+            util::mysql::bindUint64(params[0], &loser);
+            if (h.Execute(STMT_USER_LOSE, USER_LOSE, params, nullptr, false) == nullptr)
+                return __Rollback(h);
+            // 提交失败时无法确定是否已经提交，由调用者重试，重试时会被识别为重复
+            return h.Exec("commit;", false);
+        }
+        virtual void PruneApplied(uint64_t epoch)
+        {
+#define PRUNE_APPLIED "delete from game_result_applied where epoch = ?;"
+            MYSQL_BIND params[1];
+            util::mysql::bindUint64(params[0], &epoch);
+            __Update(STMT_PRUNE_APPLIED, PRUNE_APPLIED, params);
+        }
+        virtual void Stats(Json::Value &out)
+        {
+            out["backend"] = "mysql";
+            __PoolStats(_pool, out["primary"]);
+            out["primary"]["reads"] = (Json::UInt64)_primaryReads.load();
+            out["fallbacks"] = (Json::UInt64)_fallbacks.load();
+            out["replicas"] = Json::Value(Json::arrayValue);
+            for (const std::unique_ptr<Replica> &r : _replicas)
+            {
+                Json::Value item;
+                item["name"] = r->name;
+                item["lag_sec"] = (Json::Int64)r->lagSec.load();
+                item["outstanding"] = r->outstanding.load();
+                item["reads"] = (Json::UInt64)r->reads.load();
+                __PoolStats(*r->pool, item);
+                out["replicas"].append(item);
+            }
+        }
+
+    private:
+        static void __PoolStats(MysqlPool &pool, Json::Value &out)
+        {
+            const MysqlPoolStats &ps = pool.Stats();
+            size_t pool_total = 0, pool_idle = 0;
+            pool.Size(pool_total, pool_idle);
+            out["pool_size"] = (Json::UInt64)pool_total;
+            out["pool_idle"] = (Json::UInt64)pool_idle;
+            out["checkouts"] = (Json::UInt64)ps.checkouts.load();
+            out["waits"] = (Json::UInt64)ps.waits.load();
+            out["wait_us_total"] = (Json::UInt64)ps.waitUsTotal.load();
+            out["wait_us_max"] = (Json::UInt64)ps.waitUsMax.load();
+            out["timeouts"] = (Json::UInt64)ps.timeouts.load();
+            out["pings"] = (Json::UInt64)ps.pings.load();
+            out["reconnects"] = (Json::UInt64)ps.reconnects.load();
+        }
+        /*记录uid刚刚写过主库，窗口期内对他的读请求发往主库*/
+        void __MarkWritten(uint64_t uid)
+        {
+            if (_replicas.empty())
+                return;
+            auto now = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(_rywMtx);
+            _recentWrites[uid] = now + std::chrono::milliseconds(ReplicaOptions::Instance().WriteWindowMs());
+            if (_recentWrites.size() > 4096) // 顺便清理过期的记录
+            {
+                for (auto it = _recentWrites.begin(); it != _recentWrites.end();)
+                    it = (it->second < now) ? _recentWrites.erase(it) : std::next(it);
+            }
+        }
+        bool __InWriteWindow(uint64_t uid)
+        {
+            std::unique_lock<std::mutex> lock(_rywMtx);
+            auto it = _recentWrites.find(uid);
+            if (it == _recentWrites.end())
+                return false;
+            if (it->second > std::chrono::steady_clock::now())
+                return true;
+            _recentWrites.erase(it);
+            return false;
+        }
+        /*选择复制延迟在允许范围内、在途请求最少的从库，没有可用从库时返回nullptr*/
+        Replica *__PickReplica(uint64_t uid)
+        {
+            if (_replicas.empty() || (uid != 0 && __InWriteWindow(uid)))
+                return nullptr;
+            int64_t max_lag = ReplicaOptions::Instance().maxLagSec;
+            Replica *best = nullptr;
+            for (const std::unique_ptr<Replica> &r : _replicas)
+            {
+                int64_t lag = r->lagSec.load(std::memory_order_relaxed);
+                if (lag < 0 || lag > max_lag)
+                    continue;
+                if (best == nullptr || r->outstanding.load(std::memory_order_relaxed) < best->outstanding.load(std::memory_order_relaxed))
+                    best = r.get();
+            }
+            return best;
+        }
+        /*只读查询：uid为0表示查询前还不知道uid。fresh非空时置为结果是否来自主库*/
+        bool __Read(uint64_t uid, StmtId id, const char *sql, MYSQL_BIND *params, UserRecord &rec, bool *fresh = nullptr)
+        {
+            Replica *r = __PickReplica(uid);
+            if (fresh != nullptr)
+                *fresh = (r == nullptr);
+            if (r != nullptr)
+            {
+                r->outstanding++;
+                bool ret = __SelectOne(*r->pool, id, sql, params, rec);
+                r->outstanding--;
+                r->reads++;
+                if (ret)
+                    return true;
+                _fallbacks++; // 刚注册的用户可能还没有复制到从库
+                if (fresh != nullptr)
+                    *fresh = true;
+            }
+            _primaryReads++;
+            return __SelectOne(_pool, id, sql, params, rec);
+        }
+        /*定期检查从库的复制延迟*/
+        void __LagLoop()
+        {
+            while (true)
+            {
+                for (const std::unique_ptr<Replica> &r : _replicas)
+                    r->lagSec = __QueryLag(*r->pool);
+                std::unique_lock<std::mutex> lock(_lagMtx);
+                if (_lagCond.wait_for(lock, std::chrono::milliseconds(ReplicaOptions::Instance().lagCheckMs), [this]() { return _stop; }))
+                    return;
+            }
+        }
+        /*SHOW SLAVE STATUS中的Seconds_Behind_Master，查询失败或复制中断时返回-1*/
+        static int64_t __QueryLag(MysqlPool &pool)
+        {
+            MysqlPool::Handle h = pool.Checkout();
+            if (!h.Valid() || !h.Exec("show slave status;"))
+                return -1;
+            MYSQL_RES *res = mysql_store_result(h.Get());
+            if (res == NULL)
+                return -1;
+            int64_t lag = -1;
+            MYSQL_ROW row = mysql_fetch_row(res);
+            MYSQL_FIELD *fields = mysql_fetch_fields(res);
+            unsigned int n = mysql_num_fields(res);
+            for (unsigned int i = 0; row != NULL && i < n; ++i)
+            {
+                if (strcmp(fields[i].name, "Seconds_Behind_Master") == 0 || strcmp(fields[i].name, "Seconds_Behind_Source") == 0)
+                {
+                    if (row[i] != NULL)
+                        lag = atoll(row[i]);
+                    break;
+                }
+            }
+            mysql_free_result(res);
+            return lag;
+        }
+        bool __Rollback(MysqlPool::Handle &h)
+        {
+            h.Exec("rollback;", false);
+            return false;
+        }
+        /*执行不返回结果集的语句*/
+        bool __Update(StmtId id, const char *sql, MYSQL_BIND *params)
+        {
+            MysqlPool::Handle h = _pool.Checkout();
+            if (!h.Valid())
+                return false;
+            return h.Execute(id, sql, params, nullptr) != nullptr;
+        }
+        /*执行查询，结果必须恰好有一行，按 id, username, score, pk_cnt, win_cnt 的顺序绑定到rec*/
+        bool __SelectOne(MysqlPool &pool, StmtId id, const char *sql, MYSQL_BIND *params, UserRecord &rec)
+        {
+            MysqlPool::Handle h = pool.Checkout();
+            if (!h.Valid())
+                return false;
+            // username 为 varchar(32)，按每个字符最多4字节(utf8mb4)留足空间，避免长的多字节用户名被截断导致fetch失败
+            char name[32 * 4 + 1];
+            unsigned long name_len = 0;
+            MYSQL_BIND results[5];
+            util::mysql::bindUint64(results[0], &rec.id);
+            util::mysql::bindString(results[1], name, sizeof(name), &name_len);
+            util::mysql::bindInt(results[2], &rec.score);
+            util::mysql::bindInt(results[3], &rec.pkCnt);
+            util::mysql::bindInt(results[4], &rec.winCnt);
+            MYSQL_STMT *stmt = h.Execute(id, sql, params, results);
+            if (stmt == nullptr)
+                return false;
+            // 按理说要么有数据，要么没有数据，就算有数据也只能有一条数据
+            bool ret = false;
+            if (mysql_stmt_num_rows(stmt) != 1)
+                mylog::ERROR_LOG("the user information queried is not unique!!");
+            else if (mysql_stmt_fetch(stmt) != 0)
+                mylog::ERROR_LOG("fetch user info failed : %s", mysql_stmt_error(stmt));
+            else
+            {
+                rec.username.assign(name, name_len < sizeof(name) ? name_len : sizeof(name));
+                ret = true;
+            }
+            mysql_stmt_free_result(stmt);
+            return ret;
+        }
+    };
+}
+
+#endif
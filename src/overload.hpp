@@ -0,0 +1,127 @@
+#ifndef _OVERLOAD_HPP_
+#define _OVERLOAD_HPP_
+/**
+ * 全局过载控制。
+ * 观察事件循环延迟、数据库在途请求数和长连接数，过载时快速拒绝新的握手和注册/登录请求，
+ * 优先保证已经在房间中对战的玩家。
+ */
+#include "util.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace gomoku
+{
+    /*过载判定阈值，需要在服务器开始监听之前设置*/
+    struct OverloadOptions
+    {
+        int lagCheckMs = 100;          // 事件循环延迟的采样间隔
+        int maxLoopLagMs = 200;        // 事件循环延迟超过该值视为过载
+        int maxDbInflight = 32;        // 数据库在途请求数超过该值视为过载
+        size_t maxConnections = 10000; // 长连接总数上限，超过后连房间连接也拒绝
+        double hallConnRatio = 0.9;    // 长连接数达到上限的该比例后，不再接受新的大厅连接，剩余名额留给房间
+
+        static OverloadOptions &Instance()
+        {
+            static OverloadOptions opt;
+            return opt;
+        }
+    };
+
+    /*过载拒绝统计*/
+    struct OverloadStats
+    {
+        std::atomic<uint64_t> shedHall{0};  // 被拒绝的大厅握手
+        std::atomic<uint64_t> shedRoom{0};  // 被拒绝的房间握手
+        std::atomic<uint64_t> shedHttp{0};  // 被拒绝的注册/登录/信息请求
+
+        static OverloadStats &Global()
+        {
+            static OverloadStats stats;
+            return stats;
+        }
+    };
+
+    class OverloadController
+    {
+    public:
+        using db_depth_func_t = std::function<int()>;
+
+    private:
+        wsserver_t *_server;
+        db_depth_func_t _dbDepth;                  // 获取数据库在途请求数
+        std::atomic<int64_t> _loopLagUs{0};        // 最近一次采样的事件循环延迟
+        std::atomic<int64_t> _connections{0};      // 当前长连接数
+        std::chrono::steady_clock::time_point _expected; // 采样定时器预期触发的时间
+
+    public:
+        OverloadController(wsserver_t *server, db_depth_func_t dbDepth)
+            : _server(server), _dbDepth(dbDepth)
+        {
+            mylog::INFO_LOG("过载控制模块初始化完成");
+        }
+        /*开始采样事件循环延迟，在io线程运行前调用*/
+        void Start()
+        {
+            __ArmLagTimer();
+        }
+        void ConnOpened() { _connections++; }
+        void ConnClosed() { _connections--; }
+
+        int64_t LoopLagMs() const { return _loopLagUs.load(std::memory_order_relaxed) / 1000; }
+        int64_t Connections() const { return _connections.load(std::memory_order_relaxed); }
+        int DbDepth() const { return _dbDepth ? _dbDepth() : 0; }
+
+        /*事件循环或数据库是否过载*/
+        bool Overloaded() const
+        {
+            const OverloadOptions &opt = OverloadOptions::Instance();
+            return LoopLagMs() > opt.maxLoopLagMs || DbDepth() > opt.maxDbInflight;
+        }
+        /*是否接受一个新的长连接握手，房间连接只受连接总数限制*/
+        bool AdmitHandshake(bool room)
+        {
+            const OverloadOptions &opt = OverloadOptions::Instance();
+            int64_t conns = Connections();
+            if (room)
+            {
+                if (conns < (int64_t)opt.maxConnections)
+                    return true;
+                OverloadStats::Global().shedRoom++;
+                return false;
+            }
+            if (!Overloaded() && conns < (int64_t)(opt.maxConnections * opt.hallConnRatio))
+                return true;
+            OverloadStats::Global().shedHall++;
+            return false;
+        }
+        /*是否接受一个需要访问数据库的http请求(注册/登录/用户信息)*/
+        bool AdmitHttp()
+        {
+            if (!Overloaded())
+                return true;
+            OverloadStats::Global().shedHttp++;
+            return false;
+        }
+
+    private:
+        void __ArmLagTimer()
+        {
+            int ms = OverloadOptions::Instance().lagCheckMs;
+            _expected = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+            _server->set_timer(ms, std::bind(&OverloadController::__OnLagTimer, this, std::placeholders::_1));
+        }
+        /*定时器实际触发时间比预期晚多少，就是事件循环的排队延迟*/
+        void __OnLagTimer(const websocketpp::lib::error_code &ec)
+        {
+            if (ec)
+                return;
+            auto lag = std::chrono::steady_clock::now() - _expected;
+            int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+            _loopLagUs = us < 0 ? 0 : us;
+            __ArmLagTimer();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef _QUERYSTATS_HPP_
+#define _QUERYSTATS_HPP_
+/**
+ * 数据库语句的耗时统计。
+ * 每条执行的语句用单调时钟计时，按语句分别记入延迟直方图：
+ * - 预处理语句以连接上的语句编号+sql区分，普通sql以sql文本区分
+ * - 直方图按2的幂划分微秒区间，输出时用区间上界估算p50/p90/p99
+ * - 超过slowMs的语句连同返回/影响的行数记入一个定长环形缓冲区，并打一条警告日志
+ * 统计结果输出到 /admin/stats/queries
+ */
+#include <jsoncpp/json/json.h>
+#include "../mylog/mylog.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gomoku
+{
+    /*语句统计参数，slowLogSize需要在启动前设置*/
+    struct QueryStatsOptions
+    {
+        int slowMs = 50;        // 超过该耗时的语句记为慢查询
+        size_t slowLogSize = 64; // 保留最近的慢查询条数
+
+        static QueryStatsOptions &Instance()
+        {
+            static QueryStatsOptions opt;
+            return opt;
+        }
+    };
+
+    class QueryStats
+    {
+    public:
+        static const int BUCKETS = 26; // 第i个区间为 [2^(i-1), 2^i) 微秒，最后一个区间包含所有更慢的语句
+
+    private:
+        /*一条语句的累计统计*/
+        struct Entry
+        {
+            long id = -1; // 预处理语句编号，普通sql为-1
+            uint64_t count = 0;
+            uint64_t errors = 0;
+            uint64_t rows = 0;
+            uint64_t totalUs = 0;
+            uint64_t maxUs = 0;
+            uint64_t buckets[BUCKETS] = {0};
+        };
+        /*一条慢查询*/
+        struct SlowQuery
+        {
+            time_t when;
+            long id;
+            std::string sql;
+            uint64_t us;
+            uint64_t rows;
+            bool ok;
+        };
+
+        std::mutex _mtx;
+        std::unordered_map<std::string, Entry> _entries;
+        std::vector<SlowQuery> _slow; // 环形缓冲区
+        size_t _slowNext = 0;         // 下一条慢查询写入的位置
+        uint64_t _slowTotal = 0;
+
+    public:
+        static QueryStats &Global()
+        {
+            static QueryStats stats;
+            return stats;
+        }
+        /*开始计时*/
+        static std::chrono::steady_clock::time_point Now()
+        {
+            return std::chrono::steady_clock::now();
+        }
+        /// 记录一次执行。id为预处理语句编号(普通sql为-1)，rows为返回或影响的行数
+        void Record(long id, const char *sql, std::chrono::steady_clock::time_point start, uint64_t rows, bool ok)
+        {
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Now() - start).count();
+            const QueryStatsOptions &opt = QueryStatsOptions::Instance();
+            bool slow = us >= (uint64_t)opt.slowMs * 1000;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                Entry &e = _entries[sql];
+                e.id = id;
+                e.count++;
+                e.rows += rows;
+                e.totalUs += us;
+                if (us > e.maxUs)
+                    e.maxUs = us;
+                if (!ok)
+                    e.errors++;
+                e.buckets[__Bucket(us)]++;
+                if (slow && opt.slowLogSize > 0)
+                {
+                    SlowQuery q{time(nullptr), id, sql, us, rows, ok};
+                    if (_slow.size() < opt.slowLogSize)
+                        _slow.push_back(q);
+                    else
+                        _slow[_slowNext] = q;
+                    _slowNext = (_slowNext + 1) % opt.slowLogSize;
+                    _slowTotal++;
+                }
+            }
+            if (slow)
+                mylog::WARN_LOG("慢查询 %lums, 行数: %lu, sql: %s", us / 1000, rows, sql);
+        }
+        /*输出所有语句的统计和最近的慢查询，慢查询按时间从新到旧排列*/
+        void ToJson(Json::Value &out)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            out["slow_ms"] = QueryStatsOptions::Instance().slowMs;
+            out["slow_total"] = (Json::UInt64)_slowTotal;
+            out["statements"] = Json::Value(Json::arrayValue);
+            for (const auto &kv : _entries)
+            {
+                const Entry &e = kv.second;
+                Json::Value item;
+                item["id"] = (Json::Int64)e.id;
+                item["sql"] = kv.first;
+                item["count"] = (Json::UInt64)e.count;
+                item["errors"] = (Json::UInt64)e.errors;
+                item["rows"] = (Json::UInt64)e.rows;
+                item["avg_us"] = (Json::UInt64)(e.count ? e.totalUs / e.count : 0);
+                item["max_us"] = (Json::UInt64)e.maxUs;
+                item["p50_us"] = (Json::UInt64)__Percentile(e, 0.50);
+                item["p90_us"] = (Json::UInt64)__Percentile(e, 0.90);
+                item["p99_us"] = (Json::UInt64)__Percentile(e, 0.99);
+                Json::Value &hist = item["histogram"];
+                for (int i = 0; i < BUCKETS; ++i)
+                    if (e.buckets[i])
+                        hist[std::to_string(__UpperUs(i))] = (Json::UInt64)e.buckets[i];
+                out["statements"].append(item);
+            }
+            out["slow"] = Json::Value(Json::arrayValue);
+            for (size_t i = 0; i < _slow.size(); ++i)
+            {
+                const SlowQuery &q = _slow[(_slowNext + _slow.size() - 1 - i) % _slow.size()];
+                Json::Value item;
+                item["time"] = (Json::Int64)q.when;
+                item["id"] = (Json::Int64)q.id;
+                item["sql"] = q.sql;
+                item["us"] = (Json::UInt64)q.us;
+                item["rows"] = (Json::UInt64)q.rows;
+                item["ok"] = q.ok;
+                out["slow"].append(item);
+            }
+        }
+
+    private:
+        static int __Bucket(uint64_t us)
+        {
+            int i = 0;
+            while (us > 0 && i < BUCKETS - 1)
+            {
+                us >>= 1;
+                ++i;
+            }
+            return i;
+        }
+        /*区间的上界(不含)*/
+        static uint64_t __UpperUs(int i)
+        {
+            return 1ull << i;
+        }
+        static uint64_t __Percentile(const Entry &e, double p)
+        {
+            if (e.count == 0)
+                return 0;
+            uint64_t target = (uint64_t)(e.count * p);
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; ++i)
+            {
+                seen += e.buckets[i];
+                if (seen > target)
+                    return std::min(__UpperUs(i), e.maxUs);
+            }
+            return e.maxUs;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef _RATE_LIMITER_HPP_
+#define _RATE_LIMITER_HPP_
+/**
+ * 令牌桶限流。
+ * 每个websocket连接、每个uid、每个http客户端ip都按请求类型各有一个令牌桶，
+ * 在解析Json之前就判断是否放行，防止单个客户端刷请求拖垮服务器。
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace gomoku
+{
+    /*限流的请求类型*/
+    enum RateClass
+    {
+        RATE_MATCH = 0, // match_start / match_stop
+        RATE_CHESS,     // put_chess
+        RATE_CHAT,      // chat
+        RATE_WS_OTHER,  // 其他websocket消息
+        RATE_HTTP_REG,  // POST /reg
+        RATE_HTTP_LOGIN,// POST /login
+        RATE_HTTP_INFO, // GET /info
+        RATE_HTTP_FILE, // 静态资源
+        RATE_CLASS_COUNT
+    };
+
+    /*令牌桶参数：每秒补充rate个令牌，最多积攒burst个，burst为0表示不限流*/
+    struct RateBudget
+    {
+        double rate;
+        double burst;
+    };
+
+    /*令牌桶，按距离上次取令牌经过的时间补充令牌，O(1)*/
+    class TokenBucket
+    {
+    private:
+        double _tokens = -1; // 小于0表示尚未初始化，第一次使用时装满
+        std::chrono::steady_clock::time_point _last;
+
+    public:
+        bool TryTake(const RateBudget &budget, std::chrono::steady_clock::time_point now)
+        {
+            if (budget.burst <= 0)
+                return true;
+            if (_tokens < 0)
+                _tokens = budget.burst;
+            else
+            {
+                double elapsed = std::chrono::duration<double>(now - _last).count();
+                _tokens += elapsed * budget.rate;
+                if (_tokens > budget.burst)
+                    _tokens = budget.burst;
+            }
+            _last = now;
+            if (_tokens < 1)
+                return false;
+            _tokens -= 1;
+            return true;
+        }
+    };
+
+    /*各类请求的限流参数，需要在服务器开始监听之前设置*/
+    struct RateLimitOptions
+    {
+        RateBudget perConn[RATE_CLASS_COUNT]; // 每个websocket连接
+        RateBudget perUid[RATE_CLASS_COUNT];  // 每个用户(同一用户的大厅和房间连接共享)
+        RateBudget perIp[RATE_CLASS_COUNT];   // 每个http客户端ip
+        size_t maxKeys = 100000;              // 每张表最多记录的uid/ip数，满了以后新key会淘汰最久未使用的key
+
+        RateLimitOptions()
+        {
+            for (int i = 0; i < RATE_CLASS_COUNT; ++i)
+                perConn[i] = perUid[i] = perIp[i] = RateBudget{0, 0};
+            perConn[RATE_MATCH] = perUid[RATE_MATCH] = RateBudget{2, 5};
+            perConn[RATE_CHESS] = perUid[RATE_CHESS] = RateBudget{5, 10};
+            perConn[RATE_CHAT] = perUid[RATE_CHAT] = RateBudget{2, 5};
+            perConn[RATE_WS_OTHER] = perUid[RATE_WS_OTHER] = RateBudget{2, 5};
+            perIp[RATE_HTTP_REG] = RateBudget{0.2, 3};
+            perIp[RATE_HTTP_LOGIN] = RateBudget{1, 5};
+            perIp[RATE_HTTP_INFO] = RateBudget{5, 10};
+            perIp[RATE_HTTP_FILE] = RateBudget{50, 100};
+        }
+        static RateLimitOptions &Instance()
+        {
+            static RateLimitOptions opt;
+            return opt;
+        }
+    };
+
+    /*被限流的请求数*/
+    struct RateLimitStats
+    {
+        std::atomic<uint64_t> limited[RATE_CLASS_COUNT];
+
+        RateLimitStats()
+        {
+            for (int i = 0; i < RATE_CLASS_COUNT; ++i)
+                limited[i] = 0;
+        }
+        static RateLimitStats &Global()
+        {
+            static RateLimitStats stats;
+            return stats;
+        }
+    };
+
+    /*
+        按key(uid或ip)管理的一组令牌桶，key的数量不超过maxKeys。
+        key按最近使用的顺序串在链表上：每秒最多一次从表尾清理一分钟内没有请求的key，
+        表满时淘汰最久未使用的key，单次请求的开销与表的大小无关
+    */
+    class RateLimiter
+    {
+    private:
+        struct Buckets
+        {
+            TokenBucket bucket[RATE_CLASS_COUNT];
+            std::list<uint64_t>::iterator lru; // 在_lru中的位置
+            std::chrono::steady_clock::time_point last; // 最近一次请求的时间
+        };
+        std::mutex _mtx;
+        std::unordered_map<uint64_t, Buckets> _buckets;
+        std::list<uint64_t> _lru; // 最近使用的key在前
+        std::chrono::steady_clock::time_point _lastPurge;
+
+    public:
+        /*key的第rc类请求是否放行*/
+        bool Allow(uint64_t key, RateClass rc, const RateBudget &budget)
+        {
+            if (budget.burst <= 0)
+                return true;
+            auto now = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (now - _lastPurge >= std::chrono::seconds(1))
+            {
+                _lastPurge = now;
+                __Purge(now);
+            }
+            auto it = _buckets.find(key);
+            if (it == _buckets.end())
+            {
+                if (!_lru.empty() && _buckets.size() >= RateLimitOptions::Instance().maxKeys)
+                    __Erase(_lru.back());
+                _lru.push_front(key);
+                it = _buckets.emplace(key, Buckets()).first;
+                it->second.lru = _lru.begin();
+            }
+            else
+                _lru.splice(_lru.begin(), _lru, it->second.lru);
+            it->second.last = now;
+            return it->second.bucket[rc].TryTake(budget, now);
+        }
+        size_t Size()
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            return _buckets.size();
+        }
+
+    private:
+        /*清理一分钟内没有请求的key，此时它们的令牌桶早已装满，删除不影响限流结果*/
+        void __Purge(std::chrono::steady_clock::time_point now)
+        {
+            while (!_lru.empty() && now - _buckets[_lru.back()].last >= std::chrono::minutes(1))
+                __Erase(_lru.back());
+        }
+        void __Erase(uint64_t key)
+        {
+            auto it = _buckets.find(key);
+            _lru.erase(it->second.lru);
+            _buckets.erase(it);
+        }
+    };
+}
+
+#endif
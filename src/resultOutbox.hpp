@@ -0,0 +1,328 @@
+#ifndef _RESULTOUTBOX_HPP_
+#define _RESULTOUTBOX_HPP_
+/**
+ * 对局结果的本地持久化发件箱。
+ * 对局结束时只把结果追加到内存队列(Record)，不等待数据库：
+ * - 刷盘线程按批写入追加文件并fdatasync，每条结果带递增的序号
+ * - 重放线程把已落盘的结果按序号顺序应用到存储后端，后端按(纪元, 序号)去重，重复应用不会重复加分
+ * - 所有结果都应用完、且文件超过truncateBytes时，用只含文件头的新文件原子替换旧文件，
+ *   新文件换一个随机纪元，旧纪元的去重记录随后删除
+ * 数据库变慢或不可用时结果留在文件中，恢复后继续重放；进程重启时从文件恢复未应用的结果。
+ * 序号只在纪元内唯一：文件丢失、换了工作目录或多个服务器共用一个数据库时，
+ * 各自的文件有不同的纪元，不会被误判为重复。
+ *
+ * 文件格式(文本，每行一条)：
+ *   S <下一个序号> <纪元>
+ *   R <序号> <胜者uid> <败者uid>
+ * 旧格式的文件头没有纪元，按纪元0重放，结果都应用完后立即换新纪元。
+ */
+#include "database.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace gomoku
+{
+    /*发件箱参数，需要在创建发件箱之前设置*/
+    struct OutboxOptions
+    {
+        std::string path = "./result_outbox.log"; // 发件箱文件
+        int flushIntervalMs = 5;                   // 刷盘线程最多攒批的时间
+        int retryMs = 1000;                        // 应用失败后的重试间隔
+        size_t truncateBytes = 64 * 1024;          // 文件超过该大小、且结果都已应用时截断
+
+        static OutboxOptions &Instance()
+        {
+            static OutboxOptions opt;
+            return opt;
+        }
+    };
+
+    /*发件箱统计*/
+    struct OutboxStats
+    {
+        std::atomic<uint64_t> recorded{0}; // 记录的对局结果数
+        std::atomic<uint64_t> fsyncs{0};   // 刷盘次数
+        std::atomic<uint64_t> applied{0};  // 应用成功的结果数(含重复)
+        std::atomic<uint64_t> failures{0}; // 应用失败次数
+        std::atomic<uint64_t> truncates{0};
+    };
+
+    class ResultOutbox
+    {
+    private:
+        /*一局的结果*/
+        struct GameResult
+        {
+            uint64_t epoch;
+            uint64_t seq;
+            uint64_t winner;
+            uint64_t loser;
+        };
+
+        UserTable *_ut;
+        int _fd = -1;
+        size_t _fileBytes = 0; // 当前文件大小，由_fileMtx保护
+        std::mutex _mtx;                   // 保护下面的队列和序号
+        std::mutex _fileMtx;               // 刷盘和截断互斥；持有期间刷盘线程手上没有未入队的批次
+        std::condition_variable _flushCond;
+        std::condition_variable _applyCond;
+        uint64_t _nextSeq = 1;
+        uint64_t _epoch = 0;                // 当前文件的纪元，由_fileMtx保护；0表示旧格式文件
+        std::vector<GameResult> _unflushed; // 已记录、尚未落盘
+        std::deque<GameResult> _durable;    // 已落盘、尚未应用
+        bool _stop = false;
+        OutboxStats _stats;
+        std::thread _flusher;
+        std::thread _replayer;
+
+    public:
+        ResultOutbox(UserTable *ut) : _ut(ut)
+        {
+            const std::string &path = OutboxOptions::Instance().path;
+            __Recover(path);
+            // 新文件(或旧格式文件中没有待应用的结果)直接换成带纪元的文件头
+            if (_epoch == 0 && _durable.empty())
+                __Rewrite(path);
+            if (_fd < 0)
+                _fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+            if (_fd < 0)
+                mylog::ERROR_LOG("打开对局结果文件失败: %s", path.c_str());
+            _flusher = std::thread(&ResultOutbox::__FlushLoop, this);
+            _replayer = std::thread(&ResultOutbox::__ReplayLoop, this);
+            mylog::INFO_LOG("对局结果发件箱初始化完成，待应用: %lu", _durable.size());
+        }
+        ~ResultOutbox()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _flushCond.notify_all();
+            _applyCond.notify_all();
+            _flusher.join();
+            _replayer.join();
+            if (_fd >= 0)
+                close(_fd);
+        }
+        /*记录一局的结果，只追加到内存队列，返回结果的序号*/
+        uint64_t Record(uint64_t winner, uint64_t loser)
+        {
+            uint64_t seq;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                seq = _nextSeq++;
+                _unflushed.push_back(GameResult{0, seq, winner, loser}); // 纪元在落盘时确定
+            }
+            _stats.recorded++;
+            _flushCond.notify_one();
+            return seq;
+        }
+        /*尚未应用到存储后端的结果数*/
+        size_t Pending()
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            return _unflushed.size() + _durable.size();
+        }
+        const OutboxStats &Stats() const { return _stats; }
+
+    private:
+        void __FlushLoop()
+        {
+            std::vector<GameResult> batch;
+            std::string buf;
+            while (true)
+            {
+                bool stop;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _flushCond.wait(lock, [this]() { return _stop || !_unflushed.empty(); });
+                    if (_unflushed.empty())
+                        return; // 退出前已经全部落盘
+                    stop = _stop;
+                }
+                // 攒一小段时间，把同时结束的多局合并成一次fdatasync
+                if (!stop)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(OutboxOptions::Instance().flushIntervalMs));
+                std::unique_lock<std::mutex> flock(_fileMtx);
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    batch.swap(_unflushed);
+                }
+                buf.clear();
+                char line[96];
+                for (GameResult &r : batch)
+                {
+                    r.epoch = _epoch;
+                    int n = snprintf(line, sizeof(line), "R %lu %lu %lu\n", r.seq, r.winner, r.loser);
+                    buf.append(line, n);
+                }
+                if (!__WriteAll(buf.data(), buf.size()) || fdatasync(_fd) != 0)
+                    mylog::ERROR_LOG("对局结果写入文件失败，仅保留在内存中");
+                _fileBytes += buf.size();
+                _stats.fsyncs++;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _durable.insert(_durable.end(), batch.begin(), batch.end());
+                }
+                batch.clear();
+                flock.unlock();
+                _applyCond.notify_one();
+            }
+        }
+        void __ReplayLoop()
+        {
+            while (true)
+            {
+                GameResult r;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _applyCond.wait(lock, [this]() { return _stop || !_durable.empty(); });
+                    if (_stop)
+                        return; // 未应用的结果留在文件中，下次启动时重放
+                    r = _durable.front();
+                }
+                if (!_ut->ApplyGameResult(r.epoch, r.seq, r.winner, r.loser))
+                {
+                    _stats.failures++;
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _applyCond.wait_for(lock, std::chrono::milliseconds(OutboxOptions::Instance().retryMs),
+                                        [this]() { return _stop; });
+                    continue;
+                }
+                _stats.applied++;
+                bool drained;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _durable.pop_front();
+                    drained = _durable.empty() && _unflushed.empty();
+                }
+                if (drained)
+                    __TryTruncate();
+            }
+        }
+        /*文件中的结果都已应用时截断文件，换一个新纪元，然后删除旧纪元的去重记录*/
+        void __TryTruncate()
+        {
+            uint64_t old;
+            {
+                std::unique_lock<std::mutex> flock(_fileMtx);
+                // 旧格式文件的纪元0不唯一，不论大小都尽快换掉
+                if (_epoch != 0 && _fileBytes < OutboxOptions::Instance().truncateBytes)
+                    return;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    if (!_durable.empty() || !_unflushed.empty())
+                        return;
+                }
+                old = _epoch;
+                if (!__Rewrite(OutboxOptions::Instance().path))
+                    return;
+            }
+            _stats.truncates++;
+            // 在这里崩溃只会留下不再用到的去重记录，不影响正确性
+            _ut->Store().PruneApplied(old);
+        }
+        /*
+            用只含文件头的新文件替换旧文件，并换一个新纪元。调用者持有_fileMtx，或者还没有启动线程。
+            先写好临时文件再rename替换，任何时刻崩溃，文件中要么是旧的结果，要么是新的文件头
+        */
+        bool __Rewrite(const std::string &path)
+        {
+            uint64_t epoch = __NewEpoch();
+            uint64_t next;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                next = _nextSeq;
+            }
+            std::string tmp = path + ".tmp";
+            int fd = open(tmp.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                return false;
+            char line[64];
+            int n = snprintf(line, sizeof(line), "S %lu %lu\n", next, epoch);
+            if (write(fd, line, n) != n || fdatasync(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0)
+            {
+                mylog::ERROR_LOG("截断对局结果文件失败");
+                close(fd);
+                return false;
+            }
+            if (_fd >= 0)
+                close(_fd);
+            _fd = fd;
+            _fileBytes = n;
+            _epoch = epoch;
+            return true;
+        }
+        /*随机的非0纪元，不依赖文件路径和进程，多个服务器之间几乎不会重复*/
+        static uint64_t __NewEpoch()
+        {
+            std::random_device rd;
+            uint64_t epoch = ((uint64_t)rd() << 32) ^ rd();
+            epoch ^= (uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+            return epoch == 0 ? 1 : epoch;
+        }
+        bool __WriteAll(const char *data, size_t len)
+        {
+            if (_fd < 0)
+                return false;
+            while (len > 0)
+            {
+                ssize_t n = write(_fd, data, len);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                len -= n;
+            }
+            return true;
+        }
+        /*启动时读取文件，恢复序号和未应用的结果*/
+        void __Recover(const std::string &path)
+        {
+            FILE *fp = fopen(path.c_str(), "r");
+            if (fp == nullptr)
+                return;
+            char line[128];
+            long good = 0;
+            while (fgets(line, sizeof(line), fp))
+            {
+                size_t len = strlen(line);
+                if (len == 0 || line[len - 1] != '\n')
+                    break; // 最后一行可能没有写完整
+                good = ftell(fp);
+                GameResult r;
+                uint64_t next, epoch = 0;
+                if (sscanf(line, "S %lu %lu", &next, &epoch) >= 1)
+                {
+                    _nextSeq = std::max(_nextSeq, next);
+                    _epoch = epoch;
+                }
+                else if (sscanf(line, "R %lu %lu %lu", &r.seq, &r.winner, &r.loser) == 3)
+                {
+                    r.epoch = _epoch;
+                    _durable.push_back(r);
+                    _nextSeq = std::max(_nextSeq, r.seq + 1);
+                }
+            }
+            fseek(fp, 0, SEEK_END);
+            bool torn = ftell(fp) > good;
+            fclose(fp);
+            if (torn && truncate(path.c_str(), good) != 0)
+                mylog::ERROR_LOG("截断对局结果文件失败: %s", path.c_str());
+            _fileBytes = good;
+        }
+    };
+}
+
+#endif
@@ -1,7 +1,8 @@
 #ifndef _ROOM_HPP_
 #define _ROOM_HPP_
-#include "database.hpp"
+#include "resultOutbox.hpp"
 #include "onlineUser.hpp"
+#include "codec.hpp"
 #include <mutex>
 #include <unordered_map>
 namespace gomoku
@@ -28,13 +29,13 @@ private:
     uint64_t _whiteUid;                    // 白棋玩家id
     uint64_t _blackUid;                    // 黑棋玩家id
     room_status _status;                   // 房间状态
-    UserTable *_ut;                        // 用户表管理模块
+    ResultOutbox *_outbox;                 // 对局结果先写入本地发件箱，再由后台线程写库
     OnlineUser *_ou;                       // 在线用户管理模块
     std::vector<std::vector<char>> _board; // 棋盘
 
 public:
-    Room(uint64_t rid, UserTable *ut, OnlineUser *ou)
-        : _rid(rid), _status(room_status::GAME_START), _playerCnt(0), _ut(ut), _ou(ou), _board(BOARD_ROW, std::vector<char>(BOARD_COL, 0))
+    Room(uint64_t rid, ResultOutbox *outbox, OnlineUser *ou)
+        : _rid(rid), _status(room_status::GAME_START), _playerCnt(0), _outbox(outbox), _ou(ou), _board(BOARD_ROW, std::vector<char>(BOARD_COL, 0))
     {
         mylog::INFO_LOG("创建房间成功，rid = %lu", _rid);
     }
@@ -42,156 +43,149 @@ public:
     {
         mylog::INFO_LOG("销毁房间成功，rid = %lu", _rid);
     }
-    /*总地处理玩家的请求*/
-    void HandleRequest(const Json::Value &req)
+    /*
+        总地处理玩家的请求(jsoncpp解析的慢路径)。
+        专用解码器不支持的消息(带转义字符的聊天内容等)走这里，转换成RoomMsg后与快路径共用处理逻辑
+    */
+    void HandleRequest(Optype op, const Json::Value &req)
     {
-        // 1.判断房间号是否一致
-        Json::Value rsp;
-        uint64_t rid = req["room_id"].asUInt64();
-        if(rid != _rid)
+        std::string message;
+        RoomMsg msg;
+        msg.op = op;
+        msg.roomId = req["room_id"].asUInt64();
+        msg.uid = req["uid"].asUInt64();
+        msg.row = req["row"].isInt() ? req["row"].asInt() : -1;
+        msg.col = req["col"].isInt() ? req["col"].asInt() : -1;
+        if(req["message"].isString())
         {
-            rsp["optype"] = req["optype"].asString();
-            rsp["result"] = false;
-            rsp["reason"] = "房间号不一致";
-            Broadcast(rsp);
-            return;
+            message = req["message"].asString();
+            msg.message.data = message.c_str();
+            msg.message.len = message.size();
         }
-        mylog::INFO_LOG("房间号一致");
-        // 2.根据不同请求调用不同的处理函数，最后广播出去
-        if(req["optype"].asString() == "put_chess") //处理下棋
+        if(op == Optype::UNKNOWN)
         {
-            rsp = HandleChess(req);
-
-            // 有winner，更新数据库数据
-            if(rsp["winner"].asUInt64() != 0)
-            {
-                uint64_t winner = rsp["winner"].asUInt64();
-                uint64_t loser = (winner == _whiteUid) ? _blackUid : _whiteUid;
-                _ut->Win(winner);
-                _ut->Lose(loser);
-                _status = room_status::GAME_OVER;
-            }
-            mylog::INFO_LOG("下棋请求处理完毕");
+            // 未知请求原样带回optype
+            std::string optype = req["optype"].asString();
+            JsonBuf buf;
+            codec::EncodeResult(buf, optype.c_str(), optype.size(), false, "未知的请求");
+            return Broadcast(buf);
         }
-        else if(req["optype"].asString() == "chat")
+        HandleRequest(msg);
+    }
+    /*总地处理玩家的请求(快路径)，响应直接编码到栈上的缓冲区中*/
+    void HandleRequest(const RoomMsg &req)
+    {
+        JsonBuf buf;
+        const char *optype = (req.op == Optype::PUT_CHESS) ? "put_chess" : "chat";
+        // 1.判断房间号是否一致
+        if(req.roomId != _rid)
         {
-            rsp = HandleChat(req);
-            mylog::INFO_LOG("聊天请求处理完毕");
+            codec::EncodeResult(buf, optype, strlen(optype), false, "房间号不一致");
+            return Broadcast(buf);
         }
-        else
+        // 2.根据不同请求调用不同的处理函数，最后广播出去
+        if(req.op == Optype::PUT_CHESS) //处理下棋
+        {
+            HandleChess(req, buf);
+            mylog::DEBUG_LOG("下棋请求处理完毕");
+            return Broadcast(buf);
+        }
+        else if(req.op == Optype::CHAT)
         {
-            rsp["optype"] = req["optype"].asString();
-            rsp["result"] = false;
-            rsp["reason"] = "未知的请求";
-            return Broadcast(rsp);
+            codec::EncodeChat(buf, req);
+            mylog::DEBUG_LOG("聊天请求处理完毕");
+            // 聊天是玩家主动发出的内容，必须送达，拥塞由慢连接剔除兜底
+            return Broadcast(buf);
         }
-        // 3.把响应广播给所有玩家
-        std::string rsp_str;
-        util::json::serialize(rsp, rsp_str);
-        // mylog::INFO_LOG("给房间中的用户广播信息：%s", rsp_str.c_str());
-        Broadcast(rsp);
+        codec::EncodeResult(buf, optype, strlen(optype), false, "未知的请求");
+        Broadcast(buf);
     }
     /*处理玩家退出房间动作*/
     void HandleExitRoom(uint64_t uid)
     {
         // 1.若下棋过程中玩家退出，则另一玩家获胜
         // 若下棋结束后退出，则正常退出
-        Json::Value rsp;
         if(_status == room_status::GAME_START)
         {
             uint64_t winnerid = (uid == _whiteUid ? _blackUid : _whiteUid);
             uint64_t loserid = (winnerid == _whiteUid ? _blackUid : _whiteUid);
-            rsp["optype"] = "put_chess";
-            rsp["result"] = true;
-            rsp["reason"] = "对方掉线，你胜利了";
-            rsp["room_id"] = _rid;
-            rsp["uid"] = uid;
-            rsp["row"] = -1;
-            rsp["col"] = -1;
-            rsp["winner"] = winnerid;
+            RoomMsg exit_msg;
+            exit_msg.op = Optype::PUT_CHESS;
+            exit_msg.roomId = _rid;
+            exit_msg.uid = uid;
             // 更新数据库用户信息
-            _ut->Win(winnerid);
-            _ut->Lose(loserid);
+            _outbox->Record(winnerid, loserid);
             _status = room_status::GAME_OVER; 
 
+            JsonBuf buf;
+            codec::EncodePutChess(buf, exit_msg, true, "对方掉线，你胜利了", winnerid);
+            Broadcast(buf);
         }
-        Broadcast(rsp);
 
         // 2.房间玩家数量-1
         _playerCnt -= 1;
     }
 private:
-    /*处理下棋动作*/
-    Json::Value HandleChess(const Json::Value &req)
+    /*处理下棋动作，响应写入buf。产生胜者时更新数据库*/
+    void HandleChess(const RoomMsg &req, JsonBuf &buf)
     {
-        /*
-            待优化，减少重复代码。。
-        */
-        Json::Value rsp = req;
-        
-        // 2.判断玩家是否在线，有人不在线，则另一个人获胜
-        int req_uid = req["uid"].asInt64();
-        int row = req["row"].asInt();
-        int col = req["col"].asInt();
+        // 1.判断玩家是否在线，有人不在线，则另一个人获胜
+        uint64_t winner = 0;
         if(_ou->InRoom(_whiteUid) == false)
+            winner = _blackUid;
+        else if(_ou->InRoom(_blackUid) == false)
+            winner = _whiteUid;
+        if(winner != 0)
         {
-            rsp["result"] = true;
-            rsp["reason"] = "对方掉线，你胜利了";
-            rsp["winner"] = _blackUid;
-            return rsp;
+            __GameOver(winner);
+            codec::EncodePutChess(buf, req, true, "对方掉线，你胜利了", winner);
+            return;
         }
-        if(_ou->InRoom(_blackUid) == false)
+        // 2.判断下棋位置是否合理，合理则下棋
+        if(req.row < 0 || req.row >= BOARD_ROW || req.col < 0 || req.col >= BOARD_COL)
         {
-            rsp["result"] = true;
-            rsp["reason"] = "对方掉线，你胜利了";
-            rsp["winner"] = _whiteUid;
-            return rsp;
+            codec::EncodePutChess(buf, req, false, "下棋位置不合法", 0);
+            return;
         }
-        // 3.判断下棋位置是否合理，合理则下棋
-        if(_board[row][col] != 0)
+        if(_board[req.row][req.col] != 0)
         {
-            rsp["result"] = false;
-            rsp["reason"] = "当前位置已经有棋子了";
-            return rsp;
+            codec::EncodePutChess(buf, req, false, "当前位置已经有棋子了", 0);
+            return;
         }
         // 下棋
-        char req_color = (req_uid == _whiteUid) ? WHITE_CHESS : BLACK_CHESS;
-        _board[row][col] = req_color;
-
-        // 4.判断下完棋后，是否有人胜利(五子连珠)
-        uint64_t winner = __win(row, col, req_color);
+        char req_color = (req.uid == _whiteUid) ? WHITE_CHESS : BLACK_CHESS;
+        _board[req.row][req.col] = req_color;
 
-        rsp["result"] = true;
+        // 3.判断下完棋后，是否有人胜利(五子连珠)
+        winner = __win(req.row, req.col, req_color);
         if(winner)
-            rsp["reason"] = "五子连珠，你赢啦！";
+        {
+            __GameOver(winner);
+            codec::EncodePutChess(buf, req, true, "五子连珠，你赢啦！", winner);
+        }
         else
-            rsp["reason"] = "继续下棋";
-        rsp["winner"] = winner;
-        return rsp;
+            codec::EncodePutChess(buf, req, true, "继续下棋", 0);
     }
-    /*处理聊天动作*/
-    Json::Value HandleChat(const Json::Value &req)
+    /*对局结束，更新数据库数据*/
+    void __GameOver(uint64_t winner)
     {
-        Json::Value rsp = req;
-        rsp["result"] = true;
-        return rsp;
+        uint64_t loser = (winner == _whiteUid) ? _blackUid : _whiteUid;
+        _outbox->Record(winner, loser);
+        _status = room_status::GAME_OVER;
     }
     
-    /*广播给房间内所有玩家*/
-    void Broadcast(const Json::Value &rsp)
+    /*广播给房间内所有玩家，policy决定接收方连接拥塞时如何处理该消息*/
+    void Broadcast(const JsonBuf &buf, SendPolicy policy = SendPolicy::RELIABLE)
     {
-        // 1.序列化json格式的rsp为字符串
-        std::string body;
-        util::json::serialize(rsp, body);
-        // 2.获取房间所有用户的连接并发送
+        // 获取房间所有用户的连接并发送
         wsserver_t::connection_ptr conn1 = _ou->GetConnFromRoom(_whiteUid);
         wsserver_t::connection_ptr conn2 =_ou->GetConnFromRoom(_blackUid);
         if(conn1.get())
-            conn1->send(body);
+            util::ws::send(conn1, buf.Data(), buf.Size(), policy);
         else
             mylog::INFO_LOG("白棋玩家获取连接失败");
         if(conn2.get())
-            conn2->send(body);
+            util::ws::send(conn2, buf.Data(), buf.Size(), policy);
         else
             mylog::INFO_LOG("黑棋玩家获取连接失败");
     }
@@ -286,7 +280,7 @@ using room_ptr = std::shared_ptr<Room>;
 class RoomManager
 {
 private:
-    UserTable *_userTable;
+    ResultOutbox *_outbox;
     OnlineUser *_onlineUser;
     uint64_t _nextRid = 1;
     std::mutex _mtx;
@@ -294,8 +288,8 @@ private:
     std::unordered_map<uint64_t, uint64_t> _users;
 
 public:
-    RoomManager(UserTable *ut, OnlineUser *olu)
-        : _userTable(ut), _onlineUser(olu)
+    RoomManager(ResultOutbox *outbox, OnlineUser *olu)
+        : _outbox(outbox), _onlineUser(olu)
     {
         std::cout << "RoomManager模块初始化完成\n";
     }
@@ -370,7 +364,7 @@ public:
 
         // 2. 创建房间并将用户信息添加到房间中
         std::unique_lock<std::mutex> lock(_mtx);
-        room_ptr rp(new Room(_nextRid, _userTable, _onlineUser));
+        room_ptr rp(new Room(_nextRid, _outbox, _onlineUser));
         rp->SetWhiteUid(uid1);
         rp->SetBlackUid(uid2);
 
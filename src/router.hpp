@@ -0,0 +1,174 @@
+#ifndef _ROUTER_HPP_
+#define _ROUTER_HPP_
+/**
+ * 请求路由：把 (method, path) 和 optype 字符串映射成枚举。
+ * 路由表中的字符串在编译期计算FNV-1a哈希并作为switch的case，
+ * 如果两个路由哈希冲突，case重复会直接编译失败，因此这组哈希对路由表而言是完美哈希。
+ * 运行时只需计算一次哈希 + 一次字符串比较，分发开销不随路由数量增长。
+ */
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace gomoku
+{
+    /*http路由*/
+    enum class HttpRoute
+    {
+        FILE,        // 静态资源(未匹配的请求)
+        REG,         // POST /reg
+        LOGIN,       // POST /login
+        INFO,        // GET /info
+        ADMIN_STATS  // GET /admin/stats 与 GET /admin/stats/<section>
+    };
+
+    /*websocket长连接类型，握手时解析一次并保存在连接上*/
+    enum class WsRoute
+    {
+        NONE,
+        HALL, // /hall
+        ROOM  // /room
+    };
+
+    /*websocket消息类型*/
+    enum class Optype
+    {
+        UNKNOWN,
+        MATCH_START,
+        MATCH_STOP,
+        PUT_CHESS,
+        CHAT
+    };
+
+    namespace router
+    {
+        const uint32_t FNV_OFFSET = 2166136261u;
+        const uint32_t FNV_PRIME = 16777619u;
+
+        /*FNV-1a哈希，C++11的constexpr只能写成递归形式*/
+        constexpr uint32_t Fnv1a(const char *s, size_t len, uint32_t h = FNV_OFFSET)
+        {
+            return len == 0 ? h : Fnv1a(s + 1, len - 1, (h ^ (uint8_t)s[0]) * FNV_PRIME);
+        }
+        /*编译期计算字符串字面量的哈希*/
+        template <size_t N>
+        constexpr uint32_t Hash(const char (&s)[N])
+        {
+            return Fnv1a(s, N - 1);
+        }
+        /*运行时在已有哈希值上继续累加，用于不拼接字符串地计算 "method path" 的哈希*/
+        inline uint32_t HashAppend(uint32_t h, const char *s, size_t len)
+        {
+            for (size_t i = 0; i < len; ++i)
+                h = (h ^ (uint8_t)s[i]) * FNV_PRIME;
+            return h;
+        }
+        inline bool Equal(const char *s, size_t len, const char *lit)
+        {
+            return strlen(lit) == len && memcmp(s, lit, len) == 0;
+        }
+
+        /*http路由匹配结果，路由以 * 结尾时，param指向请求路径最后一段(路径参数)*/
+        struct HttpMatch
+        {
+            HttpRoute route;
+            const char *param;
+            size_t paramLen;
+        };
+
+        inline bool __HttpLookup(uint32_t h, const char *key, size_t len, HttpRoute &route)
+        {
+#define HTTP_ROUTE(str, val)                                  \
+    case Hash(str):                                           \
+        if (!Equal(key, len, str))                            \
+            return false;                                     \
+        route = val;                                          \
+        return true;
+            switch (h)
+            {
+                HTTP_ROUTE("POST /reg", HttpRoute::REG)
+                HTTP_ROUTE("POST /login", HttpRoute::LOGIN)
+                HTTP_ROUTE("GET /info", HttpRoute::INFO)
+                HTTP_ROUTE("GET /admin/stats", HttpRoute::ADMIN_STATS)
+                HTTP_ROUTE("GET /admin/stats/*", HttpRoute::ADMIN_STATS)
+            default:
+                return false;
+            }
+#undef HTTP_ROUTE
+        }
+
+        /*
+            匹配http路由：
+            1. 先去掉查询字符串，按 "method path" 精确匹配
+            2. 匹配不到时，把最后一段路径替换成 * 再匹配一次，最后一段作为路径参数
+            3. 都匹配不到，作为静态资源请求
+        */
+        inline HttpMatch MatchHttp(const std::string &method, const std::string &uri)
+        {
+            HttpMatch m = {HttpRoute::FILE, nullptr, 0};
+            size_t path_len = uri.find('?');
+            if (path_len == std::string::npos)
+                path_len = uri.size();
+            // 最长的路由 "GET /admin/stats/*" 也只有十几个字节，更长的请求一定是静态资源
+            char key[64];
+            if (method.size() + 1 + path_len + 2 > sizeof(key))
+                return m;
+            size_t len = 0;
+            memcpy(key + len, method.c_str(), method.size());
+            len += method.size();
+            key[len++] = ' ';
+            memcpy(key + len, uri.c_str(), path_len);
+            len += path_len;
+            if (__HttpLookup(HashAppend(FNV_OFFSET, key, len), key, len, m.route))
+                return m;
+
+            if (path_len == 0)
+                return m;
+            size_t slash = uri.rfind('/', path_len - 1);
+            if (slash == std::string::npos || slash + 1 >= path_len)
+                return m;
+            size_t prefix_len = method.size() + 1 + slash;
+            memcpy(key + prefix_len, "/*", 2);
+            if (__HttpLookup(HashAppend(FNV_OFFSET, key, prefix_len + 2), key, prefix_len + 2, m.route))
+            {
+                m.param = uri.c_str() + slash + 1;
+                m.paramLen = path_len - slash - 1;
+            }
+            return m;
+        }
+
+        /*匹配websocket长连接类型*/
+        inline WsRoute MatchWs(const std::string &uri)
+        {
+            switch (HashAppend(FNV_OFFSET, uri.c_str(), uri.size()))
+            {
+            case Hash("/hall"):
+                return Equal(uri.c_str(), uri.size(), "/hall") ? WsRoute::HALL : WsRoute::NONE;
+            case Hash("/room"):
+                return Equal(uri.c_str(), uri.size(), "/room") ? WsRoute::ROOM : WsRoute::NONE;
+            default:
+                return WsRoute::NONE;
+            }
+        }
+
+        /*匹配websocket消息类型*/
+        inline Optype MatchOptype(const char *s, size_t len)
+        {
+#define OPTYPE_ROUTE(str, val) \
+    case Hash(str):            \
+        return Equal(s, len, str) ? val : Optype::UNKNOWN;
+            switch (HashAppend(FNV_OFFSET, s, len))
+            {
+                OPTYPE_ROUTE("match_start", Optype::MATCH_START)
+                OPTYPE_ROUTE("match_stop", Optype::MATCH_STOP)
+                OPTYPE_ROUTE("put_chess", Optype::PUT_CHESS)
+                OPTYPE_ROUTE("chat", Optype::CHAT)
+            default:
+                return Optype::UNKNOWN;
+            }
+#undef OPTYPE_ROUTE
+        }
+    }
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include "session.hpp"
 #include "matcher.hpp"
 #include "room.hpp"
+#include "overload.hpp"
 
 namespace gomoku
 {
@@ -18,19 +19,32 @@ namespace gomoku
     private:
         wsserver_t _wssvr;    // 服务器主体
         UserTable _ut;        // 用户信息表管理
+        AsyncUserTable _aut;  // 用户信息表的异步接口，供io线程使用
+        ResultOutbox _outbox; // 对局结果发件箱
         OnlineUser _ou;       // 在线用户管理
         RoomManager _rm;      // 房间管理
         SessionManager _sm;   // 会话管理
         Matcher _mch;         // 玩家匹配管理
         std::string _webRoot; // 静态资源根目录
+        RateLimiter _uidLimiter; // 按用户限流
+        RateLimiter _ipLimiter;  // 按http客户端ip限流
+        OverloadController _olc; // 过载控制
     public:
         /*成员初始化*/
         GomokuServer(const char *host, uint16_t port, const char *mysql_usr, const char *mysql_pwd, const char *db_name, const std::string &wwwroot = WWWROOT)
-            : _ut(host, port, mysql_usr, mysql_pwd, db_name)
-            , _rm(&_ut, &_ou)
+            : GomokuServer(std::unique_ptr<UserStore>(new MysqlUserStore(host, port, mysql_usr, mysql_pwd, db_name)), wwwroot)
+        {
+        }
+        /*使用指定的存储后端，例如压测时使用进程内存储*/
+        GomokuServer(std::unique_ptr<UserStore> store, const std::string &wwwroot = WWWROOT)
+            : _ut(std::move(store))
+            , _aut(&_ut, &_wssvr)
+            , _outbox(&_ut)
+            , _rm(&_outbox, &_ou)
             , _sm(&_wssvr)
             , _mch(&_rm, &_ut, &_ou)
             , _webRoot(wwwroot)
+            , _olc(&_wssvr, std::bind(&AsyncUserTable::Depth, &_aut))
         {
             // 1.初始化websocket服务器设置
             _wssvr.set_access_channels(websocketpp::log::alevel::none); //设置websocketpp库日志为失效
@@ -39,16 +53,38 @@ namespace gomoku
 
             // 2.设置 http请求的回调 & websocket请求的回调
             _wssvr.set_http_handler(std::bind(&GomokuServer::HttpCallback, this, std::placeholders::_1)); //设置http请求时的动作
+            _wssvr.set_validate_handler(std::bind(&GomokuServer::WsValidateCallback, this, std::placeholders::_1)); //设置websocket握手时的准入判断
             _wssvr.set_open_handler(std::bind(&GomokuServer::WsOpenCallback, this, std::placeholders::_1)); //设置websocket握手成功时的动作
             _wssvr.set_close_handler(std::bind(&GomokuServer::WsCloseCallback, this, std::placeholders::_1)); //设置websocket关闭连接时的动作
             _wssvr.set_message_handler(std::bind(&GomokuServer::WsMsgCallback, this, std::placeholders::_1, std::placeholders::_2)); //设置websocket消息推送时的动作
         }
+        /*设置permessage-deflate压缩参数，需要在Start之前调用*/
+        void SetDeflateOptions(const DeflateOptions &opt)
+        {
+            DeflateOptions::Instance() = opt;
+        }
+        /*设置发送缓冲区水位和慢连接剔除参数，需要在Start之前调用*/
+        void SetOutboundOptions(const OutboundOptions &opt)
+        {
+            OutboundOptions::Instance() = opt;
+        }
+        /*设置限流参数，需要在Start之前调用*/
+        void SetRateLimitOptions(const RateLimitOptions &opt)
+        {
+            RateLimitOptions::Instance() = opt;
+        }
+        /*设置过载控制阈值，需要在Start之前调用*/
+        void SetOverloadOptions(const OverloadOptions &opt)
+        {
+            OverloadOptions::Instance() = opt;
+        }
         /*启动服务器*/
         void Start(int port)
         { 
             std::cout << "启动服务器\n";
             _wssvr.listen(port);
             _wssvr.start_accept();
+            _olc.Start();
             _wssvr.run();
         }
     private: /*_wssvr的回调函数*/
@@ -56,57 +92,106 @@ namespace gomoku
         /*处理http请求的回调*/
         void HttpCallback(websocketpp::connection_hdl hdl)
         {
-            // 1.获取连接对象conn
+            // 1.获取连接对象conn，查路由表得到请求对应的处理函数
             wsserver_t::connection_ptr conn = _wssvr.get_con_from_hdl(hdl);
-            auto req = conn->get_request();
-            std::string method = req.get_method();
-            std::string uri = req.get_uri();
+            const std::string &method = conn->get_request().get_method();
+            const std::string &uri = conn->get_request().get_uri();
+            router::HttpMatch route = router::MatchHttp(method, uri);
+
+            // 2.按客户端ip限流，在读取请求正文之前进行
+            RateClass rc = __RateClassOf(route.route);
+            if(__AllowHttp(conn, rc) == false)
+            {
+                mylog::DEBUG_LOG("http请求过于频繁: %s %s", method.c_str(), uri.c_str());
+                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::too_many_requests, "请求过于频繁");
+            }
+            // 3.过载时快速拒绝需要访问数据库的请求
+            if(rc != RATE_HTTP_FILE && _olc.AdmitHttp() == false)
+            {
+                mylog::DEBUG_LOG("服务器过载，拒绝请求: %s %s", method.c_str(), uri.c_str());
+                conn->append_header("Retry-After", "1");
+                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::service_unavailable, "服务器繁忙，请稍后重试");
+            }
             
-            // 2.根据不同请求，调用不同的业务处理函数
-            if(method == "POST" && uri == "/reg")
+            // 4.根据不同请求，调用不同的业务处理函数
+            switch(route.route)
+            {
+            case HttpRoute::ADMIN_STATS:
+                return StatsHandler(conn, std::string(route.param ? route.param : "", route.paramLen)); //服务器运行统计
+            case HttpRoute::REG:
                 return RegisteHandler(conn); //注册请求
-            else if(method == "POST" && uri == "/login")
+            case HttpRoute::LOGIN:
                 return LoginHandler(conn); //登录请求
-            else if(method == "GET" && uri == "/info")
+            case HttpRoute::INFO:
                 return InfoHandler(conn); //用户信息请求
-            else 
+            default:
                 return FileHandler(conn); //静态资源请求
+            }
+        }
+        /*websocket握手时的准入判断，过载时返回503。长连接类型在这里解析一次并保存在连接上*/
+        bool WsValidateCallback(websocketpp::connection_hdl hdl)
+        {
+            wsserver_t::connection_ptr conn = _wssvr.get_con_from_hdl(hdl);
+            conn->route = router::MatchWs(conn->get_request().get_uri());
+            if(conn->route == WsRoute::NONE)
+            {
+                conn->set_status(websocketpp::http::status_code::not_found);
+                return false;
+            }
+            bool room = (conn->route == WsRoute::ROOM);
+            if(_olc.AdmitHandshake(room))
+                return true;
+            mylog::DEBUG_LOG("服务器过载，拒绝%s握手", room ? "房间" : "大厅");
+            conn->set_status(websocketpp::http::status_code::service_unavailable);
+            conn->append_header("Retry-After", "1");
+            return false;
         }
         /*处理websocket长连接开启的回调*/
         void WsOpenCallback(websocketpp::connection_hdl hdl)
         {
-            // 1.根据http资源路径，判断是什么长连接请求
+            // 1.根据握手时解析的长连接类型分发
             wsserver_t::connection_ptr conn = _wssvr.get_con_from_hdl(hdl);
-            auto req = conn->get_request();
-            std::string uri = req.get_uri();
-            if(uri == "/hall") //建立游戏大厅的长连接
+            _olc.ConnOpened();
+            if(conn->route == WsRoute::HALL) //建立游戏大厅的长连接
                 WsOpenHall(conn);
-            else if(uri == "/room") //建立游戏房间的长连接
+            else if(conn->route == WsRoute::ROOM) //建立游戏房间的长连接
                 WsOpenRoom(conn);
         }
         /*处理websocket长连接断开的回调*/
         void WsCloseCallback(websocketpp::connection_hdl hdl)
         {
-            // 1.根据http资源路径，判断是什么长连接请求
+            // 1.根据握手时解析的长连接类型分发
             wsserver_t::connection_ptr conn = _wssvr.get_con_from_hdl(hdl);
-            auto req = conn->get_request();
-            std::string uri = req.get_uri();
-            if(uri == "/hall") //关闭游戏大厅的长连接
+            _olc.ConnClosed();
+            mylog::DEBUG_LOG("连接关闭，压缩率: %.3f (%lu -> %lu bytes)", conn->compress.Ratio(),
+                             conn->compress.rawBytes.load(), conn->compress.wireBytes.load());
+            if(conn->route == WsRoute::HALL) //关闭游戏大厅的长连接
                 WsCloseHall(conn);
-            else if(uri == "/room") //关闭游戏房间的长连接
+            else if(conn->route == WsRoute::ROOM) //关闭游戏房间的长连接
                 WsCloseRoom(conn);
         }
         /*处理websocket长连接通信消息的回调*/
         void WsMsgCallback(websocketpp::connection_hdl hdl, wsserver_t::message_ptr msg)
         {
-            // 1.根据http资源路径，判断是什么长连接请求
             wsserver_t::connection_ptr conn = _wssvr.get_con_from_hdl(hdl);
-            auto req = conn->get_request();
-            std::string uri = req.get_uri();
-            if(uri == "/hall") //处理游戏大厅长连接的消息请求
-                WsMsgHall(conn, msg);
-            else if(uri == "/room") //处理游戏房间长连接的消息请求
-                WsMsgRoom(conn, msg);
+            // 1.不解析Json，直接从消息中取出optype并查表
+            const char *op_str = nullptr;
+            size_t op_len = 0;
+            Optype op = Optype::UNKNOWN;
+            if(util::json::peekString(msg->get_payload(), "optype", op_str, op_len))
+                op = router::MatchOptype(op_str, op_len);
+            // 2.限流：在解析Json之前，判断该连接和该用户的令牌是否足够
+            if(__AllowWs(conn, __RateClassOf(op)) == false)
+            {
+                mylog::DEBUG_LOG("websocket请求过于频繁, uid: %lu", conn->uid);
+                std::string op_name = op_str ? std::string(op_str, op_len) : "unknow";
+                return __OrganizeWebSocketResponseJson(conn, op_name.c_str(), false, "请求过于频繁", SendPolicy::DROPPABLE);
+            }
+            // 3.根据握手时解析的长连接类型分发
+            if(conn->route == WsRoute::HALL) //处理游戏大厅长连接的消息请求
+                WsMsgHall(conn, op, msg);
+            else if(conn->route == WsRoute::ROOM) //处理游戏房间长连接的消息请求
+                WsMsgRoom(conn, op, msg);
         }
 
     private:/*Http回调函数调用的业务处理*/
@@ -115,8 +200,7 @@ namespace gomoku
         void FileHandler(wsserver_t::connection_ptr conn)
         {
             //1.组织文件所在的路径
-            websocketpp::http::parser::request req = conn->get_request();
-            std::string uri = req.get_uri();
+            const std::string &uri = conn->get_request().get_uri();
             std::string filepath = _webRoot + uri;
             //2.如果该路径是一个目录，+ "login.html"
             if(filepath.back() == '/')
@@ -141,7 +225,6 @@ namespace gomoku
         void RegisteHandler(wsserver_t::connection_ptr conn)
         {
             // 1.获取请求正文
-            websocketpp::http::parser::request req = conn->get_request();
             std::string req_body = conn->get_request_body();
             // 2.对json格式的正文进行反序列化，获取用户名&密码
             Json::Value reg_info;
@@ -157,20 +240,25 @@ namespace gomoku
                 mylog::DEBUG_LOG("未输入用户名/密码");
                 return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "未输入用户名/密码");
             }
-            // 4.将用户名&密码录入数据库
-            ret = _ut.AddtUser(reg_info); 
-            if(false == ret)
-            {
-                mylog::DEBUG_LOG("用户名已被占用");
-                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "用户名已被占用");
-            }
-            return __OrganizeHttpResponseJson(conn, true, websocketpp::http::status_code::ok, "注册成功");
+            // 4.将用户名&密码录入数据库，在数据库线程执行，完成后再发送响应
+            conn->defer_http_response();
+            _aut.AddtUser(reg_info["username"].asString(), reg_info["password"].asString(), [this, conn](DbStatus st) mutable {
+                if(st == DbStatus::OK)
+                    __OrganizeHttpResponseJson(conn, true, websocketpp::http::status_code::ok, "注册成功");
+                else if(st == DbStatus::FAILED)
+                {
+                    mylog::DEBUG_LOG("用户名已被占用");
+                    __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "用户名已被占用");
+                }
+                else
+                    __OrganizeDbUnavailable(conn, st);
+                __SendDeferred(conn);
+            }, __CancelOnClose(conn));
         }
         /*处理用户登录请求*/
         void LoginHandler(wsserver_t::connection_ptr conn)
         {
             //1.获取请求正文并反序列化
-            websocketpp::http::parser::request req = conn->get_request();
             std::string req_body = conn->get_request_body();
             Json::Value login_info;
             bool ret = util::json::unserialize(req_body, login_info);
@@ -185,14 +273,25 @@ namespace gomoku
                 mylog::DEBUG_LOG("未输入用户名/密码");
                 return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "未输入用户名/密码");
             }
-            ret = _ut.SelectByUsrPwd(login_info);
-            if(false == ret)
-            {
-                mylog::DEBUG_LOG("用户名/密码错误");
-                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "用户名/密码错误");
-            }
+            conn->defer_http_response();
+            _aut.SelectByUsrPwd(login_info["username"].asString(), login_info["password"].asString(),
+                                [this, conn](DbStatus st, UserRecord &user) mutable {
+                if(st == DbStatus::OK)
+                    __LoginSucceed(conn, user.id);
+                else if(st == DbStatus::FAILED)
+                {
+                    mylog::DEBUG_LOG("用户名/密码错误");
+                    __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "用户名/密码错误");
+                }
+                else
+                    __OrganizeDbUnavailable(conn, st);
+                __SendDeferred(conn);
+            }, __CancelOnClose(conn));
+        }
+        /*登录验证成功，给客户端创建session*/
+        void __LoginSucceed(wsserver_t::connection_ptr &conn, uint64_t uid)
+        {
             //3.验证成功，给客户端创建session
-            uint64_t uid = login_info["id"].asInt64();
             Session::ptr sp = _sm.CreateSession(uid, LOGIN);
             if(sp.get() == nullptr)
             {
@@ -230,25 +329,97 @@ namespace gomoku
                 mylog::INFO_LOG("无法找到Session对象，请重新登录");
                 return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "无法找到Session对象，请重新登录");
             }
-            // 2.会话中有uid，根据uid从数据库中提取用户信息并响应
+            // 2.会话中有uid，根据uid提取用户信息并响应(缓存未命中时在数据库线程查询)
             uint64_t uid = sp->GetUid();
-            Json::Value user_info;
-            ret = _ut.SelectById(uid, user_info);
-            if(false == ret)
-            {
-                mylog::INFO_LOG("无法找到用户信息");
-                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "无法找到用户信息");
-            }
-            // 获取信息成功，组织响应
+            uint64_t sid = sp->GetSid();
+            conn->defer_http_response();
+            _aut.SelectById(uid, [this, conn, sid](DbStatus st, UserRecord &user) mutable {
+                if(st == DbStatus::FAILED)
+                {
+                    mylog::INFO_LOG("无法找到用户信息");
+                    __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::bad_request, "无法找到用户信息");
+                    return __SendDeferred(conn);
+                }
+                if(st != DbStatus::OK)
+                {
+                    __OrganizeDbUnavailable(conn, st);
+                    return __SendDeferred(conn);
+                }
+                // 获取信息成功，组织响应
+                Json::Value user_info;
+                user_info["id"] = (Json::UInt64)user.id;
+                user_info["username"] = user.username;
+                user_info["score"] = user.score;
+                user_info["pk_cnt"] = user.pkCnt;
+                user_info["win_cnt"] = user.winCnt;
+                std::string body;
+                util::json::serialize(user_info, body);
+                conn->set_body(body);
+                conn->append_header("Content-Type", "application/json");
+                conn->set_status(websocketpp::http::status_code::ok);
+
+                // 3.刷新会话过期时间
+                _sm.SetSessionTime(sid, SESSION_TIMEOUT);
+                __SendDeferred(conn);
+            }, __CancelOnClose(conn));
+        }
+
+        /*对端是否为本机地址，按socket的对端地址判断，包括IPv4映射的IPv6地址(::ffff:127.x.x.x)*/
+        bool __IsLoopback(wsserver_t::connection_ptr conn)
+        {
+            websocketpp::lib::asio::error_code ec;
+            websocketpp::lib::asio::ip::address addr = conn->get_raw_socket().remote_endpoint(ec).address();
+            if (ec)
+                return false;
+            if (addr.is_v6() && addr.to_v6().is_v4_mapped())
+                return addr.to_v6().to_bytes()[12] == 127;
+            return addr.is_loopback();
+        }
+        /*处理服务器运行统计请求，只允许本机访问。section非空时只返回对应的部分，如 /admin/stats/overload*/
+        void StatsHandler(wsserver_t::connection_ptr conn, const std::string &section)
+        {
+            if (!__IsLoopback(conn))
+                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::forbidden, "只允许本机访问");
+            Json::Value stats;
+            stats["overload"]["loop_lag_ms"] = (Json::Int64)_olc.LoopLagMs();
+            stats["overload"]["connections"] = (Json::Int64)_olc.Connections();
+            stats["overload"]["db_inflight"] = _olc.DbDepth();
+            stats["overload"]["shed_hall"] = (Json::UInt64)OverloadStats::Global().shedHall.load();
+            stats["overload"]["shed_room"] = (Json::UInt64)OverloadStats::Global().shedRoom.load();
+            stats["overload"]["shed_http"] = (Json::UInt64)OverloadStats::Global().shedHttp.load();
+            stats["outbound"]["congested"] = (Json::UInt64)OutboundStats::Global().congested.load();
+            stats["outbound"]["dropped"] = (Json::UInt64)OutboundStats::Global().dropped.load();
+            stats["outbound"]["evicted"] = (Json::UInt64)OutboundStats::Global().evicted.load();
+            stats["compress"]["raw_bytes"] = (Json::UInt64)CompressStats::Global().rawBytes.load();
+            stats["compress"]["wire_bytes"] = (Json::UInt64)CompressStats::Global().wireBytes.load();
+            stats["compress"]["deflated_frames"] = (Json::UInt64)CompressStats::Global().deflatedFrames.load();
+            stats["compress"]["plain_frames"] = (Json::UInt64)CompressStats::Global().plainFrames.load();
+            stats["compress"]["ratio"] = CompressStats::Global().Ratio();
+            _ut.Store().Stats(stats["db"]);
+            QueryStats::Global().ToJson(stats["queries"]);
+            const OutboxStats &obs = _outbox.Stats();
+            stats["outbox"]["pending"] = (Json::UInt64)_outbox.Pending();
+            stats["outbox"]["recorded"] = (Json::UInt64)obs.recorded.load();
+            stats["outbox"]["fsyncs"] = (Json::UInt64)obs.fsyncs.load();
+            stats["outbox"]["applied"] = (Json::UInt64)obs.applied.load();
+            stats["outbox"]["failures"] = (Json::UInt64)obs.failures.load();
+            stats["outbox"]["truncates"] = (Json::UInt64)obs.truncates.load();
+            const UserCacheStats &cs = _ut.Cache().Stats();
+            stats["user_cache"]["size"] = (Json::UInt64)_ut.Cache().Size();
+            stats["user_cache"]["hits"] = (Json::UInt64)cs.hits.load();
+            stats["user_cache"]["misses"] = (Json::UInt64)cs.misses.load();
+            stats["user_cache"]["evictions"] = (Json::UInt64)cs.evictions.load();
+            stats["user_cache"]["updates"] = (Json::UInt64)cs.updates.load();
+            const char *rate_names[RATE_CLASS_COUNT] = {"match", "chess", "chat", "ws_other", "reg", "login", "info", "file"};
+            for(int i = 0; i < RATE_CLASS_COUNT; ++i)
+                stats["rate_limited"][rate_names[i]] = (Json::UInt64)RateLimitStats::Global().limited[i].load();
+            if(!section.empty() && !stats.isMember(section))
+                return __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::not_found, "没有该统计项");
             std::string body;
-            util::json::serialize(user_info, body);
-            // std::cout << "InfoHandler(): 从数据库中拿出来响应的数据: " << body << std::endl;
+            util::json::serialize(section.empty() ? stats : stats[section], body);
             conn->set_body(body);
             conn->append_header("Content-Type", "application/json");
             conn->set_status(websocketpp::http::status_code::ok);
-
-            // 3.刷新会话过期时间
-            _sm.SetSessionTime(sp->GetSid(), SESSION_TIMEOUT);
         }
 
     private:/*websocket回调函数调用的业务处理*/
@@ -269,6 +440,7 @@ namespace gomoku
                 __OrganizeWebSocketResponseJson(conn, "hall_ready", false, "用户重复登录！");
             }
             // 3.将当前客户加入游戏大厅
+            conn->uid = sp->GetUid();
             _ou.EnterHall(sp->GetUid(), conn);
             // 4.响应给客户端
             __OrganizeWebSocketResponseJson(conn, "hall_ready", true, "建立游戏大厅长连接成功！");
@@ -292,23 +464,17 @@ namespace gomoku
             if(rp.get() == nullptr)
             {
                 mylog::INFO_LOG("未找到当前用户的房间！");
-                __OrganizeWebSocketResponseJson(conn, "room_ready", false, "未找到当前用户的房间！");
+                return __OrganizeWebSocketResponseJson(conn, "room_ready", false, "未找到当前用户的房间！");
             }
             //4.将当前用户添加进房间中的在线用户管理中
+            conn->uid = sp->GetUid();
             _ou.EnterRoom(sp->GetUid(), conn);
             //5.设置Session生效时间为永久
             _sm.SetSessionTime(sp->GetSid(), SESSION_FOREVER);
             //6.响应给客户端
-            Json::Value rsp;
-            rsp["optype"] = "room_ready";
-            rsp["result"] = true;
-            rsp["room_id"] = (Json::UInt64)rp->GetRid();
-            rsp["uid"] = (Json::UInt64)sp->GetUid();
-            rsp["white_id"] = (Json::UInt64)rp->GetWhiteUid();
-            rsp["black_id"] = (Json::UInt64)rp->GetBlackUid();
-            std::string body;
-            util::json::serialize(rsp, body);
-            conn->send(body);
+            JsonBuf buf;
+            codec::EncodeRoomReady(buf, rp->GetRid(), sp->GetUid(), rp->GetWhiteUid(), rp->GetBlackUid());
+            util::ws::send(conn, buf.Data(), buf.Size());
         }
         /*关闭游戏大厅的长连接*/
         void WsCloseHall(wsserver_t::connection_ptr conn)
@@ -336,74 +502,74 @@ namespace gomoku
             _rm.RemoveUser(sp->GetUid());
         }
         /*处理游戏大厅长连接的消息请求*/
-        void WsMsgHall(wsserver_t::connection_ptr conn, wsserver_t::message_ptr msg)
+        void WsMsgHall(wsserver_t::connection_ptr conn, Optype op, wsserver_t::message_ptr msg)
         {
-            std::string rsp_str;
-            Json::Value rsp_json;
             // 1.身份验证，判断当前用户是否在线，获取用户id
             Session::ptr sp = __GetSessionByCookie(conn);
             if(sp.get() == nullptr) return;
-            // 2.获取通信请求信息
-            std::string req_str = msg->get_payload();
-            Json::Value req_json;
-            bool ret = util::json::unserialize(req_str, req_json);
-            if(ret == false)
-            {
-                return __OrganizeWebSocketResponseJson(conn, "json_unserialize_failed", false, "客户端发送的请求Json解析失败");
-            }
-            // 3.处理通信请求：开始匹配对战、停止匹配对战
-            if(!req_json["optype"].isNull() && req_json["optype"].asString() == "match_start")
+            // 2.处理通信请求：开始匹配对战、停止匹配对战，这两种请求只有optype字段，无需解析Json
+            switch(op)
             {
+            case Optype::MATCH_START:
                 _mch.Add(sp->GetUid());
                 return __OrganizeWebSocketResponseJson(conn, "match_start", true, "成功添加到匹配队列");
-            }
-            else if(!req_json["optype"].isNull() && req_json["optype"].asString() == "match_stop")
-            {
+            case Optype::MATCH_STOP:
                 _mch.Del(sp->GetUid());
                 return __OrganizeWebSocketResponseJson(conn, "match_stop", true, "从匹配队列中移除");
+            default:
+                break;
+            }
+            // 3.未知请求，区分Json格式错误与未知的optype
+            Json::Value req_json;
+            if(util::json::unserialize(msg->get_payload(), req_json) == false)
+            {
+                return __OrganizeWebSocketResponseJson(conn, "json_unserialize_failed", false, "客户端发送的请求Json解析失败");
             }
-            else
-                return __OrganizeWebSocketResponseJson(conn, "unkonw", false, "未知的请求");
+            return __OrganizeWebSocketResponseJson(conn, "unkonw", false, "未知的请求");
         }
         /*处理游戏房间长连接的消息请求*/
-        void WsMsgRoom(wsserver_t::connection_ptr conn, wsserver_t::message_ptr msg)
+        void WsMsgRoom(wsserver_t::connection_ptr conn, Optype op, wsserver_t::message_ptr msg)
         {
-            // 1.获取用户session
-            Session::ptr sp = __GetSessionByCookie(conn);
-            if(sp.get() == nullptr)
+            // 1.获取用户id：房间长连接建立时已经记录在连接上，不必每条消息都解析Cookie
+            uint64_t uid = conn->uid;
+            if(uid == 0)
             {
-                mylog::INFO_LOG("无法找到会话");
-                return;
+                Session::ptr sp = __GetSessionByCookie(conn);
+                if(sp.get() == nullptr)
+                {
+                    mylog::INFO_LOG("无法找到会话");
+                    return;
+                }
+                uid = sp->GetUid();
             }
             // 2.获取用户房间信息
-            room_ptr rp = _rm.GetRoomByUid(sp->GetUid());
+            room_ptr rp = _rm.GetRoomByUid(uid);
             if(rp.get() == nullptr)
             {
                 mylog::INFO_LOG("未找到当前用户的房间！");
-                __OrganizeWebSocketResponseJson(conn, "wsmsg", false, "未找到当前用户的房间！");
+                return __OrganizeWebSocketResponseJson(conn, "wsmsg", false, "未找到当前用户的房间！");
             }
-            // 3.把请求信息反序列化成json并让Room对象处理并响应
+            // 3.热点消息(put_chess/chat)直接解码到RoomMsg，不构造Json::Value
+            const std::string &payload = msg->get_payload();
+            RoomMsg room_msg;
+            if(codec::DecodeRoomMsg(payload.c_str(), payload.size(), op, room_msg))
+                return rp->HandleRequest(room_msg);
+            // 4.其他消息退回jsoncpp解析
             Json::Value req;
-            std::string req_str = msg->get_payload();
-            if(util::json::unserialize(req_str, req) == false)
+            if(util::json::unserialize(payload, req) == false)
             {
                 mylog::INFO_LOG("无法解析请求");
                 return __OrganizeWebSocketResponseJson(conn, "wsmsg", false, "无法解析请求");
             }
-            mylog::INFO_LOG("开始处理Room请求");
-            rp->HandleRequest(req);
+            rp->HandleRequest(op, req);
         }
     private:/*一些辅助性的函数*/
         /*组织一个json格式的websocket响应(减少重复代码)*/
-        void __OrganizeWebSocketResponseJson(wsserver_t::connection_ptr conn, const std::string& optype, bool result ,const std::string& reason)
+        void __OrganizeWebSocketResponseJson(wsserver_t::connection_ptr conn, const char *optype, bool result, const char *reason, SendPolicy policy = SendPolicy::RELIABLE)
         {
-            Json::Value rsp;
-            rsp["optype"] = optype;
-            rsp["result"] = result;
-            rsp["reason"] = reason;
-            std::string body;
-            util::json::serialize(rsp, body);
-            conn->send(body);
+            JsonBuf buf;
+            codec::EncodeResult(buf, optype, strlen(optype), result, reason);
+            util::ws::send(conn, buf.Data(), buf.Size(), policy);
         }
         /*组织一个json格式的http响应(减少重复代码)*/
         void __OrganizeHttpResponseJson(wsserver_t::connection_ptr& conn, bool result, websocketpp::http::status_code::value status, const std::string& reason)
@@ -417,6 +583,93 @@ namespace gomoku
             conn->set_body(body);
             conn->append_header("Content-Type", "application/json");
         }
+        /*数据库超时/繁忙时的响应*/
+        void __OrganizeDbUnavailable(wsserver_t::connection_ptr& conn, DbStatus st)
+        {
+            mylog::ERROR_LOG("数据库请求未完成, status: %d", (int)st);
+            conn->append_header("Retry-After", "1");
+            __OrganizeHttpResponseJson(conn, false, websocketpp::http::status_code::service_unavailable, "服务器繁忙，请稍后重试");
+        }
+        /*
+            推迟响应期间客户端断开时取消数据库调用：请求已经读完，websocketpp在发送响应前不会再读这个socket，
+            在上面挂一个peek读，读到EOF或出错说明连接已经关闭。写操作开始执行后不会被取消
+        */
+        DbCallOptions __CancelOnClose(wsserver_t::connection_ptr& conn)
+        {
+            DbCallOptions opt;
+            opt.cancel = std::make_shared<CancelToken>();
+            std::shared_ptr<char> byte(new char[1], std::default_delete<char[]>());
+            std::shared_ptr<CancelToken> token = opt.cancel;
+            conn->get_raw_socket().async_receive(websocketpp::lib::asio::buffer(byte.get(), 1),
+                                                 websocketpp::lib::asio::socket_base::message_peek,
+                [token, byte](const websocketpp::lib::asio::error_code &ec, size_t n) {
+                    if(ec || n == 0)
+                        token->Cancel();
+                });
+            return opt;
+        }
+        /*发送之前被推迟的http响应，客户端可能已经断开，忽略错误*/
+        void __SendDeferred(wsserver_t::connection_ptr& conn)
+        {
+            websocketpp::lib::error_code ec;
+            conn->send_http_response(ec);
+            if(ec)
+                mylog::DEBUG_LOG("发送推迟的http响应失败: %s", ec.message().c_str());
+        }
+        /*确定限流的请求类型*/
+        RateClass __RateClassOf(Optype op)
+        {
+            switch(op)
+            {
+            case Optype::MATCH_START:
+            case Optype::MATCH_STOP:
+                return RATE_MATCH;
+            case Optype::PUT_CHESS:
+                return RATE_CHESS;
+            case Optype::CHAT:
+                return RATE_CHAT;
+            default:
+                return RATE_WS_OTHER;
+            }
+        }
+        RateClass __RateClassOf(HttpRoute route)
+        {
+            switch(route)
+            {
+            case HttpRoute::REG:
+                return RATE_HTTP_REG;
+            case HttpRoute::LOGIN:
+                return RATE_HTTP_LOGIN;
+            case HttpRoute::INFO:
+                return RATE_HTTP_INFO;
+            default:
+                return RATE_HTTP_FILE;
+            }
+        }
+        /*websocket消息限流：连接和用户的令牌桶都要有令牌*/
+        bool __AllowWs(wsserver_t::connection_ptr& conn, RateClass rc)
+        {
+            const RateLimitOptions &opt = RateLimitOptions::Instance();
+            bool allow = conn->rate[rc].TryTake(opt.perConn[rc], std::chrono::steady_clock::now());
+            if(allow && conn->uid != 0)
+                allow = _uidLimiter.Allow(conn->uid, rc, opt.perUid[rc]);
+            if(allow == false)
+                RateLimitStats::Global().limited[rc]++;
+            return allow;
+        }
+        /*http请求限流：按客户端ip(不含端口)*/
+        bool __AllowHttp(wsserver_t::connection_ptr& conn, RateClass rc)
+        {
+            std::string ep = conn->get_remote_endpoint();
+            size_t pos = ep.rfind(':');
+            if(pos != std::string::npos)
+                ep.resize(pos);
+            uint64_t key = std::hash<std::string>()(ep);
+            bool allow = _ipLimiter.Allow(key, rc, RateLimitOptions::Instance().perIp[rc]);
+            if(allow == false)
+                RateLimitStats::Global().limited[rc]++;
+            return allow;
+        }
         /*获取HttpCookie中指定key的value值*/
         bool __GetCookieValueByKey(const std::string& cookie, const std::string& key, std::string& value)
         {
@@ -96,10 +96,43 @@ namespace gomoku
     }
 
 }
-int main()
+/*
+    ./test                                   使用MySQL
+    ./test memory [WAL文件] [延迟us] [抖动us]  使用进程内存储，可以在没有MySQL的环境中压测
+    ./test replica host:port [host:port ...]   写主库，读请求分发到这些从库(账号、库名与主库相同)
+*/
+int main(int argc, char *argv[])
 {
     std::cout << "Start" << std::endl;
+    if (argc > 1 && std::string(argv[1]) == "memory")
+    {
+        gomoku::MemoryStoreOptions &opt = gomoku::MemoryStoreOptions::Instance();
+        if (argc > 2)
+            opt.walPath = argv[2];
+        if (argc > 3)
+            opt.latencyUs = atoi(argv[3]);
+        if (argc > 4)
+            opt.jitterUs = atoi(argv[4]);
+        gomoku::GomokuServer svr(std::unique_ptr<gomoku::UserStore>(new gomoku::MemoryUserStore()));
+        svr.Start(8888);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "replica")
+    {
+        gomoku::MysqlEndpoint primary{HOST, PORT, USER, PASS, DBNAME};
+        std::vector<gomoku::MysqlEndpoint> replicas;
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string addr = argv[i];
+            size_t pos = addr.rfind(':');
+            uint16_t port = pos == std::string::npos ? 3306 : (uint16_t)atoi(addr.c_str() + pos + 1);
+            replicas.push_back(gomoku::MysqlEndpoint{addr.substr(0, pos), port, USER, PASS, DBNAME});
+        }
+        gomoku::GomokuServer svr(std::unique_ptr<gomoku::UserStore>(new gomoku::MysqlUserStore(primary, replicas)));
+        svr.Start(8888);
+        return 0;
+    }
     gomoku::GomokuServer svr(HOST, PORT, USER, PASS, DBNAME);
     svr.Start(8888);
     return 0;
-}
\ No newline at end of file
+}
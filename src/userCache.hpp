@@ -0,0 +1,192 @@
+#ifndef _USERCACHE_HPP_
+#define _USERCACHE_HPP_
+/**
+ * 用户信息的分片LRU缓存，放在UserTable前面。
+ * 按uid分到多个分片，每个分片一把锁、一条LRU链表，容量满时淘汰最久未访问的记录。
+ * 对局结果(Win/Lose)写库成功后直接在缓存中原地修改分数和场次，不需要重新查库；
+ * 写库期间并发查库得到的结果不会放入缓存，因此匹配分段使用的分数与数据库保持一致。
+ */
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gomoku
+{
+    /// @brief user表中的一行
+    struct UserRecord
+    {
+        uint64_t id = 0;
+        std::string username;
+        int score = 0;
+        int pkCnt = 0;
+        int winCnt = 0;
+    };
+
+    /*缓存参数，需要在创建UserTable之前设置*/
+    struct UserCacheOptions
+    {
+        size_t shards = 16;      // 分片数
+        size_t capacity = 8192;  // 所有分片合计的记录数上限
+
+        static UserCacheOptions &Instance()
+        {
+            static UserCacheOptions opt;
+            return opt;
+        }
+    };
+
+    /*缓存统计*/
+    struct UserCacheStats
+    {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> updates{0}; // 原地修改次数
+    };
+
+    class UserCache
+    {
+    private:
+        struct Shard
+        {
+            std::mutex mtx;
+            std::list<UserRecord> lru; // 表头是最近访问的记录
+            std::unordered_map<uint64_t, std::list<UserRecord>::iterator> index;
+            uint64_t version = 0; // 每次修改/删除记录时递增，用于丢弃过期的查库结果
+            std::unordered_map<uint64_t, int> pending; // 正在写库的用户
+        };
+        std::vector<Shard> _shards;
+        size_t _shardCapacity;
+        UserCacheStats _stats;
+
+    public:
+        UserCache()
+            : _shards(UserCacheOptions::Instance().shards == 0 ? 1 : UserCacheOptions::Instance().shards)
+        {
+            size_t n = _shards.size();
+            _shardCapacity = (UserCacheOptions::Instance().capacity + n - 1) / n;
+            if (_shardCapacity == 0)
+                _shardCapacity = 1;
+        }
+        /*
+            查找记录，命中时移到LRU表头。
+            未命中时通过version返回分片当前版本，查库后交给Put，
+            如果期间该分片有记录被修改，Put会丢弃这次可能已经过期的结果
+        */
+        bool Get(uint64_t id, UserRecord &rec, uint64_t &version)
+        {
+            Shard &s = __ShardOf(id);
+            std::unique_lock<std::mutex> lock(s.mtx);
+            auto it = s.index.find(id);
+            if (it == s.index.end())
+            {
+                version = s.version;
+                _stats.misses++;
+                return false;
+            }
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            rec = *it->second;
+            _stats.hits++;
+            return true;
+        }
+        /*放入查库得到的记录，version为Get未命中时返回的版本*/
+        void Put(const UserRecord &rec, uint64_t version)
+        {
+            Shard &s = __ShardOf(rec.id);
+            std::unique_lock<std::mutex> lock(s.mtx);
+            if (s.version != version || s.pending.count(rec.id))
+                return;
+            __Insert(s, rec);
+        }
+        /*
+            对局结果写库之前调用。写库期间该用户的查库结果一律不放入缓存，
+            已有的缓存记录保持写库前的值，写库成功后由EndUpdate原地修改
+        */
+        void BeginUpdate(uint64_t id)
+        {
+            Shard &s = __ShardOf(id);
+            std::unique_lock<std::mutex> lock(s.mtx);
+            s.version++;
+            s.pending[id]++;
+        }
+        /*对局结果写库之后调用：成功则原地修改分数和场次，失败则删除记录，下次查询时重新读库*/
+        void EndUpdate(uint64_t id, bool win, bool ok)
+        {
+            Shard &s = __ShardOf(id);
+            std::unique_lock<std::mutex> lock(s.mtx);
+            s.version++;
+            auto p = s.pending.find(id);
+            if (p != s.pending.end() && --p->second == 0)
+                s.pending.erase(p);
+            auto it = s.index.find(id);
+            if (it == s.index.end())
+                return;
+            if (!ok)
+            {
+                s.lru.erase(it->second);
+                s.index.erase(it);
+                return;
+            }
+            UserRecord &rec = *it->second;
+            rec.score += win ? 30 : -30;
+            rec.pkCnt++;
+            if (win)
+                rec.winCnt++;
+            _stats.updates++;
+        }
+        /*删除记录，数据库状态不确定时使用*/
+        void Erase(uint64_t id)
+        {
+            Shard &s = __ShardOf(id);
+            std::unique_lock<std::mutex> lock(s.mtx);
+            s.version++;
+            auto it = s.index.find(id);
+            if (it == s.index.end())
+                return;
+            s.lru.erase(it->second);
+            s.index.erase(it);
+        }
+        const UserCacheStats &Stats() const { return _stats; }
+        size_t Size()
+        {
+            size_t n = 0;
+            for (Shard &s : _shards)
+            {
+                std::unique_lock<std::mutex> lock(s.mtx);
+                n += s.index.size();
+            }
+            return n;
+        }
+
+    private:
+        Shard &__ShardOf(uint64_t id)
+        {
+            // uid是自增的，乘一个奇数常量打散后再取模，避免连续uid集中在相邻分片
+            return _shards[(id * 0x9E3779B97F4A7C15ull >> 32) % _shards.size()];
+        }
+        void __Insert(Shard &s, const UserRecord &rec)
+        {
+            auto it = s.index.find(rec.id);
+            if (it != s.index.end())
+            {
+                *it->second = rec;
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+                return;
+            }
+            s.lru.push_front(rec);
+            s.index[rec.id] = s.lru.begin();
+            if (s.index.size() > _shardCapacity)
+            {
+                s.index.erase(s.lru.back().id);
+                s.lru.pop_back();
+                _stats.evictions++;
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _USERSTORE_HPP_
+#define _USERSTORE_HPP_
+/**
+ * 用户数据的存储后端接口。
+ * UserTable只通过该接口访问数据，缓存、异步执行等逻辑与具体后端无关：
+ * - MysqlUserStore：线上使用的MySQL后端
+ * - MemoryUserStore：进程内存储，可选WAL文件持久化，可注入延迟，用于隔离环境下的压测
+ * 所有接口都可能被多个线程同时调用，实现需要自己保证线程安全。
+ */
+#include "userCache.hpp"
+#include "util.hpp"
+
+namespace gomoku
+{
+    class UserStore
+    {
+    public:
+        virtual ~UserStore() {}
+        /// 新增用户，用户名已存在时返回false
+        virtual bool Insert(const std::string &username, const std::string &password) = 0;
+        /// 根据用户名+密码查询，密码错误或用户不存在时返回false
+        virtual bool SelectByUsrPwd(const std::string &username, const std::string &password, UserRecord &rec) = 0;
+        virtual bool SelectById(uint64_t id, UserRecord &rec) = 0;
+        /// 同上，fresh置为false表示结果来自可能有复制延迟的从库，调用者不应把它放入缓存
+        virtual bool SelectById(uint64_t id, UserRecord &rec, bool &fresh)
+        {
+            fresh = true;
+            return SelectById(id, rec);
+        }
+        virtual bool SelectByName(const std::string &name, UserRecord &rec) = 0;
+        /// 对局结果：胜者 score+30, pk_cnt+1, win_cnt+1；败者 score-30, pk_cnt+1
+        virtual bool Win(uint64_t id) = 0;
+        virtual bool Lose(uint64_t id) = 0;
+        /// 幂等地应用一局的结果：(epoch, seq)已经应用过时不再修改，duplicate置为true并返回true
+        virtual bool ApplyGameResult(uint64_t epoch, uint64_t seq, uint64_t winner, uint64_t loser, bool &duplicate) = 0;
+        /// epoch内的结果不会再被重放，可以删除该纪元的去重记录
+        virtual void PruneApplied(uint64_t epoch) = 0;
+        /// 后端自身的运行统计，输出到 /admin/stats/db
+        virtual void Stats(Json::Value &out) = 0;
+    };
+}
+
+#endif
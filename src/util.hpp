@@ -7,14 +7,17 @@
 #include <memory>
 #include <vector>
 #include <cstdint>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <functional>
 #include <jsoncpp/json/json.h>
 #include <mysql/mysql.h>
 #include "../mylog/mylog.h"
+#include "wsConfig.hpp"
+#include "queryStats.hpp"
 
-#include <websocketpp/server.hpp>
-#include <websocketpp/config/asio_no_tls.hpp>
-
-typedef websocketpp::server<websocketpp::config::asio> wsserver_t;
+typedef websocketpp::server<gomoku::GomokuWsConfig> wsserver_t;
 namespace gomoku
 {
     namespace util
@@ -56,10 +59,13 @@ namespace gomoku
                 }
                 return mysql;
             }
-            /// 执行sql语句
+            /// 执行sql语句，耗时和影响的行数记入QueryStats
             static bool exec(MYSQL *mysql, const std::string &sql)
             {
+                auto start = QueryStats::Now();
                 int ret = mysql_query(mysql, sql.c_str());
+                uint64_t rows = ret == 0 ? mysql_affected_rows(mysql) : 0; // 返回结果集的语句为-1
+                QueryStats::Global().Record(-1, sql.c_str(), start, rows == (uint64_t)-1 ? 0 : rows, ret == 0);
                 if (ret != 0)
                 {
                     mylog::ERROR_LOG("%s\n", sql.c_str());
@@ -68,6 +74,29 @@ namespace gomoku
                 }
                 return true;
             }
+            /// 绑定预处理语句的参数/结果
+            static void bindUint64(MYSQL_BIND &bind, uint64_t *val)
+            {
+                memset(&bind, 0, sizeof(bind));
+                bind.buffer_type = MYSQL_TYPE_LONGLONG;
+                bind.buffer = val;
+                bind.is_unsigned = true;
+            }
+            static void bindInt(MYSQL_BIND &bind, int *val)
+            {
+                memset(&bind, 0, sizeof(bind));
+                bind.buffer_type = MYSQL_TYPE_LONG;
+                bind.buffer = val;
+            }
+            /// 作为参数时length为字符串长度；作为结果时size为缓冲区大小，length返回实际长度
+            static void bindString(MYSQL_BIND &bind, const char *buf, unsigned long size, unsigned long *length)
+            {
+                memset(&bind, 0, sizeof(bind));
+                bind.buffer_type = MYSQL_TYPE_STRING;
+                bind.buffer = (void *)buf;
+                bind.buffer_length = size;
+                bind.length = length;
+            }
             /// 销毁mysql句柄
             static void destroy(MYSQL *mysql)
             {
@@ -79,33 +108,113 @@ namespace gomoku
 
         class json
         {
+        private:
+            /// 把输出追加到指定std::string的streambuf，配合复用的std::string避免每次序列化都重新分配
+            class StringSink : public std::streambuf
+            {
+            public:
+                std::string *target = nullptr;
+
+            protected:
+                virtual int_type overflow(int_type ch)
+                {
+                    if (ch != traits_type::eof())
+                        target->push_back((char)ch);
+                    return ch;
+                }
+                virtual std::streamsize xsputn(const char *s, std::streamsize n)
+                {
+                    target->append(s, n);
+                    return n;
+                }
+            };
+            /// 每个线程一份的序列化器：紧凑输出(无缩进)，中文直接输出UTF-8而不是\uXXXX
+            struct Writer
+            {
+                StringSink sink;
+                std::ostream os;
+                std::unique_ptr<Json::StreamWriter> sw;
+                Writer() : os(&sink)
+                {
+                    Json::StreamWriterBuilder swb;
+                    swb["indentation"] = "";
+                    swb["emitUTF8"] = true;
+                    sw.reset(swb.newStreamWriter());
+                }
+            };
+            static Writer &__writer()
+            {
+                static thread_local Writer w;
+                return w;
+            }
+            static Json::CharReader &__reader()
+            {
+                static thread_local std::unique_ptr<Json::CharReader> cr(Json::CharReaderBuilder().newCharReader());
+                return *cr;
+            }
+
         public:
+            /// 序列化到str中，str原有内容被覆盖；调用者复用同一个str时不会重新分配内存
             static bool serialize(const Json::Value &root, std::string &str)
             {
-                Json::StreamWriterBuilder swb;
-                std::unique_ptr<Json::StreamWriter> sw(swb.newStreamWriter());
-                std::stringstream ss;
-                int ret = sw->write(root, &ss);
-                if (ret != 0)
+                Writer &w = __writer();
+                str.clear();
+                w.sink.target = &str;
+                int ret = w.sw->write(root, &w.os);
+                w.sink.target = nullptr;
+                if (ret != 0 || !w.os.good())
                 {
+                    w.os.clear();
                     mylog::ERROR_LOG("json serialize failed!!");
                     return false;
                 }
-                str = ss.str();
                 return true;
             }
             static bool unserialize(const std::string &str, Json::Value &root)
             {
-                Json::CharReaderBuilder crb;
-                std::unique_ptr<Json::CharReader> cr(crb.newCharReader());
+                return unserialize(str.c_str(), str.size(), root);
+            }
+            static bool unserialize(const char *data, size_t len, Json::Value &root)
+            {
+                // 成功时不需要错误信息，失败时再解析一遍取错误信息
+                if (__reader().parse(data, data + len, &root, nullptr))
+                    return true;
                 std::string err;
-                bool ret = cr->parse(str.c_str(), str.c_str() + str.size(), &root, &err);
-                if (ret == false)
-                {
-                    mylog::ERROR_LOG("json unserialize failed: %s", err.c_str());
+                __reader().parse(data, data + len, &root, &err);
+                mylog::ERROR_LOG("json unserialize failed: %s", err.c_str());
+                return false;
+            }
+            /// 不解析整个Json，直接在原始字符串中查找 "key":"value" 形式的字符串字段，不分配内存。
+            /// 只用于解析前的快速判断(如限流)，值中带转义字符时返回false
+            static bool peekString(const std::string &str, const char *key, const char *&val, size_t &len)
+            {
+                char needle[64];
+                int n = snprintf(needle, sizeof(needle), "\"%s\"", key);
+                if (n <= 0 || n >= (int)sizeof(needle))
                     return false;
+                size_t pos = 0;
+                while ((pos = str.find(needle, pos)) != std::string::npos)
+                {
+                    size_t i = pos + n;
+                    pos = i;
+                    while (i < str.size() && isspace((unsigned char)str[i]))
+                        ++i;
+                    if (i >= str.size() || str[i] != ':')
+                        continue; // 匹配到的是某个值，不是key
+                    ++i;
+                    while (i < str.size() && isspace((unsigned char)str[i]))
+                        ++i;
+                    if (i >= str.size() || str[i] != '"')
+                        return false;
+                    size_t begin = i + 1;
+                    size_t end = str.find_first_of("\"\\", begin);
+                    if (end == std::string::npos || str[end] != '"')
+                        return false;
+                    val = str.c_str() + begin;
+                    len = end - begin;
+                    return true;
                 }
-                return true;
+                return false;
             }
         };
         class string
@@ -166,6 +275,93 @@ namespace gomoku
                 return true;
             }
         };
+        class ws
+        {
+        public:
+            /// 发送一条文本消息，长度达到DeflateOptions::minCompressSize时才允许压缩。
+            /// 待发送字节数超过高水位时连接进入拥塞状态，DROPPABLE的消息被丢弃，
+            /// 持续拥塞超过OutboundOptions::slowConsumerMs的连接会被关闭。
+            /// 返回false表示消息被丢弃
+            static bool send(const wsserver_t::connection_ptr &conn, const std::string &body, SendPolicy policy = SendPolicy::RELIABLE)
+            {
+                return send(conn, body.c_str(), body.size(), policy);
+            }
+            static bool send(const wsserver_t::connection_ptr &conn, const char *data, size_t len, SendPolicy policy = SendPolicy::RELIABLE)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(conn->outMtx);
+                    if (conn->congested == false && conn->get_buffered_amount() >= OutboundOptions::Instance().highWatermark)
+                    {
+                        conn->congested = true;
+                        conn->congestedAt = std::chrono::steady_clock::now();
+                        OutboundStats::Global().congested++;
+                        mylog::INFO_LOG("连接发送缓冲区超过高水位: %lu bytes", conn->get_buffered_amount());
+                        __armDrainCheck(conn);
+                    }
+                    if (conn->congested && policy == SendPolicy::DROPPABLE)
+                    {
+                        OutboundStats::Global().dropped++;
+                        return false;
+                    }
+                }
+                __sendNow(conn, data, len);
+                return true;
+            }
+
+        private:
+            static void __sendNow(const wsserver_t::connection_ptr &conn, const char *data, size_t len)
+            {
+                wsserver_t::message_ptr msg = conn->get_con_msg_manager()->get_message(websocketpp::frame::opcode::text, len);
+                msg->set_payload(data, len);
+                msg->set_compressed(len >= DeflateOptions::Instance().minCompressSize);
+
+                // 协商了压缩扩展时，压缩在conn->send中同步完成，
+                // DeflateExtension记录压缩后的大小后会把Current()置空
+                CompressStats &stats = conn->compress;
+                CompressStats::Current() = &stats;
+                conn->send(msg);
+                bool plain = (CompressStats::Current() != nullptr);
+                CompressStats::Current() = nullptr;
+
+                stats.rawBytes += len;
+                CompressStats::Global().rawBytes += len;
+                if (plain)
+                {
+                    stats.wireBytes += len;
+                    stats.plainFrames++;
+                    CompressStats::Global().wireBytes += len;
+                    CompressStats::Global().plainFrames++;
+                }
+            }
+            /// 拥塞期间定时检查发送缓冲区(调用者持有conn->outMtx)
+            static void __armDrainCheck(const wsserver_t::connection_ptr &conn)
+            {
+                conn->set_timer(OutboundOptions::Instance().drainCheckMs,
+                                std::bind(&ws::__drainCheck, conn, std::placeholders::_1));
+            }
+            static void __drainCheck(wsserver_t::connection_ptr conn, const websocketpp::lib::error_code &ec)
+            {
+                if (ec || conn->get_state() != websocketpp::session::state::open)
+                    return;
+                std::unique_lock<std::mutex> lock(conn->outMtx);
+                const OutboundOptions &opt = OutboundOptions::Instance();
+                if (conn->get_buffered_amount() > opt.lowWatermark)
+                {
+                    auto elapsed = std::chrono::steady_clock::now() - conn->congestedAt;
+                    if (elapsed < std::chrono::milliseconds(opt.slowConsumerMs))
+                        return __armDrainCheck(conn);
+                    // 持续拥塞，剔除慢连接
+                    OutboundStats::Global().evicted++;
+                    mylog::INFO_LOG("慢连接持续拥塞，关闭连接，待发送: %lu bytes", conn->get_buffered_amount());
+                    lock.unlock();
+                    websocketpp::lib::error_code close_ec;
+                    conn->close(websocketpp::close::status::try_again_later, "slow consumer", close_ec);
+                    return;
+                }
+                // 降到低水位以下，恢复正常
+                conn->congested = false;
+            }
+        };
     }
 }
 #endif
\ No newline at end of file
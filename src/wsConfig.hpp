@@ -0,0 +1,187 @@
+#ifndef _WS_CONFIG_HPP_
+#define _WS_CONFIG_HPP_
+/**
+ * websocketpp服务器的配置。
+ * 在默认的asio配置上开启permessage-deflate扩展，并给每个连接挂上自定义数据(ConnData)。
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <websocketpp/server.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include "rateLimiter.hpp"
+#include "router.hpp"
+
+namespace gomoku
+{
+    /*permessage-deflate压缩参数，需要在服务器开始监听之前设置*/
+    struct DeflateOptions
+    {
+        bool serverNoContextTakeover = false; // 服务端每条消息都重置压缩上下文(省内存，压缩率下降)
+        bool clientNoContextTakeover = false; // 要求客户端每条消息都重置压缩上下文
+        uint8_t serverMaxWindowBits = 15;     // 服务端压缩窗口大小(9~15)
+        uint8_t clientMaxWindowBits = 15;     // 要求客户端使用的压缩窗口大小(9~15)
+        size_t minCompressSize = 128;         // 小于该长度的消息不压缩，直接发送
+
+        static DeflateOptions &Instance()
+        {
+            static DeflateOptions opt;
+            return opt;
+        }
+    };
+
+    /*压缩统计：原始字节数 & 实际发送的负载字节数*/
+    struct CompressStats
+    {
+        std::atomic<uint64_t> rawBytes{0};         // 交给send的负载总字节数
+        std::atomic<uint64_t> wireBytes{0};        // 压缩后(或未压缩)实际发送的负载字节数
+        std::atomic<uint64_t> deflatedFrames{0};   // 压缩发送的消息数
+        std::atomic<uint64_t> plainFrames{0};      // 未压缩发送的消息数
+
+        /*压缩率：实际发送字节 / 原始字节，越小越好*/
+        double Ratio() const
+        {
+            uint64_t raw = rawBytes.load(std::memory_order_relaxed);
+            if (raw == 0)
+                return 1.0;
+            return (double)wireBytes.load(std::memory_order_relaxed) / raw;
+        }
+        /*全部连接的汇总统计*/
+        static CompressStats &Global()
+        {
+            static CompressStats stats;
+            return stats;
+        }
+        /*当前线程正在发送的连接的统计，由util::ws::send在调用conn->send前设置，压缩完成后被置空*/
+        static CompressStats *&Current()
+        {
+            static thread_local CompressStats *cur = nullptr;
+            return cur;
+        }
+    };
+
+    /*发送缓冲区水位参数，需要在服务器开始监听之前设置*/
+    struct OutboundOptions
+    {
+        size_t highWatermark = 256 * 1024; // 待发送字节数超过该值，连接进入拥塞状态
+        size_t lowWatermark = 64 * 1024;   // 拥塞后待发送字节数降到该值以下，恢复正常
+        int drainCheckMs = 100;            // 拥塞期间检查发送缓冲区的间隔
+        int slowConsumerMs = 10000;        // 持续拥塞超过该时间，关闭连接
+
+        static OutboundOptions &Instance()
+        {
+            static OutboundOptions opt;
+            return opt;
+        }
+    };
+
+    /*发送背压统计(全局)*/
+    struct OutboundStats
+    {
+        std::atomic<uint64_t> congested{0}; // 连接进入拥塞状态的次数
+        std::atomic<uint64_t> dropped{0};   // 拥塞时被丢弃的消息数
+        std::atomic<uint64_t> evicted{0};   // 因持续拥塞被关闭的连接数
+
+        static OutboundStats &Global()
+        {
+            static OutboundStats stats;
+            return stats;
+        }
+    };
+
+    /*消息在连接拥塞时的处理方式*/
+    enum class SendPolicy
+    {
+        RELIABLE, // 必须送达：拥塞时照常排队，由慢连接剔除兜底
+        DROPPABLE // 可丢弃：拥塞时直接丢弃并计入OutboundStats::dropped(限流提示等)
+    };
+
+    /*每个websocket连接附带的数据，websocketpp的connection类会继承它*/
+    class ConnData : public websocketpp::connection_base
+    {
+    public:
+        WsRoute route = WsRoute::NONE;         // 长连接类型，握手时解析一次
+        uint64_t uid = 0;                      // 连接所属用户，长连接建立成功后设置
+        TokenBucket rate[RATE_CLASS_COUNT];    // 当前连接各类请求的令牌桶，只在io线程中访问
+        CompressStats compress;                // 当前连接的压缩统计
+
+        // 发送背压状态，由util::ws维护
+        std::mutex outMtx;
+        bool congested = false;                             // 是否处于拥塞状态
+        std::chrono::steady_clock::time_point congestedAt; // 进入拥塞状态的时间
+    };
+
+    /*
+        permessage-deflate扩展：在websocketpp自带实现的基础上，
+        1. 构造时按DeflateOptions设置上下文复用和窗口大小
+        2. 压缩时把压缩前后的字节数记到当前连接的统计中
+        websocketpp的processor直接以配置中的类型调用compress，因此这里隐藏基类的同名函数即可。
+    */
+    template <typename config>
+    class DeflateExtension : public websocketpp::extensions::permessage_deflate::enabled<config>
+    {
+        typedef websocketpp::extensions::permessage_deflate::enabled<config> base;
+
+    public:
+        DeflateExtension()
+        {
+            namespace pmd = websocketpp::extensions::permessage_deflate;
+            const DeflateOptions &opt = DeflateOptions::Instance();
+            if (opt.serverNoContextTakeover)
+                this->enable_server_no_context_takeover();
+            if (opt.clientNoContextTakeover)
+                this->enable_client_no_context_takeover();
+            if (opt.serverMaxWindowBits < 15)
+                this->set_server_max_window_bits(opt.serverMaxWindowBits, pmd::mode::smallest);
+            if (opt.clientMaxWindowBits < 15)
+                this->set_client_max_window_bits(opt.clientMaxWindowBits, pmd::mode::smallest);
+        }
+        websocketpp::lib::error_code compress(const std::string &in, std::string &out)
+        {
+            size_t before = out.size();
+            websocketpp::lib::error_code ec = base::compress(in, out);
+            CompressStats *stats = CompressStats::Current();
+            if (!ec && stats != nullptr)
+            {
+                stats->wireBytes += out.size() - before;
+                stats->deflatedFrames++;
+                CompressStats::Global().wireBytes += out.size() - before;
+                CompressStats::Global().deflatedFrames++;
+                CompressStats::Current() = nullptr; // 告知util::ws::send本条消息已压缩
+            }
+            return ec;
+        }
+    };
+
+    /*在websocketpp::config::asio的基础上开启permessage-deflate，并挂载ConnData*/
+    struct GomokuWsConfig : public websocketpp::config::asio
+    {
+        typedef GomokuWsConfig type;
+        typedef websocketpp::config::asio base;
+
+        typedef base::concurrency_type concurrency_type;
+        typedef base::request_type request_type;
+        typedef base::response_type response_type;
+        typedef base::message_type message_type;
+        typedef base::con_msg_manager_type con_msg_manager_type;
+        typedef base::endpoint_msg_manager_type endpoint_msg_manager_type;
+        typedef base::alog_type alog_type;
+        typedef base::elog_type elog_type;
+        typedef base::rng_type rng_type;
+        typedef base::transport_type transport_type;
+        typedef base::endpoint_base endpoint_base;
+
+        typedef ConnData connection_base;
+
+        struct permessage_deflate_config
+        {
+            typedef base::request_type request_type;
+        };
+        typedef DeflateExtension<permessage_deflate_config> permessage_deflate_type;
+    };
+}
+
+#endif